@@ -8,7 +8,8 @@
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
-// * When done with the buffer, call brelse.
+// * When done with the buffer, call brelse, or brelsecold
+//     if its contents are file data.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
@@ -123,6 +124,23 @@ bwrite(struct buf *b)
   }
 }
 
+// Write data as the new contents of block blockno of dev
+// straight to the disk, not through the log. If the log holds
+// an uncommitted copy of the block, update that copy instead,
+// so that the commit can't overwrite the data with older contents.
+void
+bwritedata(uint dev, uint blockno, char *data)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  memmove(b->data, data, BSIZE);
+  b->flags |= B_VALID;
+  if((b->flags & B_DIRTY) == 0)
+    bwrite(b);
+  brelsecold(b);
+}
+
 // Release a locked buffer.
 // Move to the head of the MRU list.
 void
@@ -147,6 +165,45 @@ brelse(struct buf *b)
   
   release(&bcache.lock);
 }
+
+// Release a locked buffer whose contents won't be wanted again
+// soon, such as file data, which the page cache keeps.
+// Move to the tail of the MRU list, to be reused first.
+void
+brelsecold(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("brelsecold");
+
+  releasesleep(&b->lock);
+
+  acquire(&bcache.lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    b->next->prev = b->prev;
+    b->prev->next = b->next;
+    b->prev = bcache.head.prev;
+    b->next = &bcache.head;
+    bcache.head.prev->next = b;
+    bcache.head.prev = b;
+  }
+  release(&bcache.lock);
+}
+
+// Forget the cached contents of every idle buffer of device dev.
+// Used when a device number is released and may be reused.
+void
+binval(uint dev)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->refcnt == 0 && (b->flags & B_DIRTY) == 0)
+      b->flags &= ~B_VALID;
+  }
+  release(&bcache.lock);
+}
 //PAGEBREAK!
 // Blank page.
 
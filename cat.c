@@ -9,6 +9,13 @@ cat(int fd)
 {
   int n;
 
+  // let the kernel move the data if it can
+  if((n = splice(fd, 1, 8192)) >= 0){
+    while(n > 0)
+      n = splice(fd, 1, 8192);
+    if(n == 0)
+      return;
+  }
   while((n = read(fd, buf, sizeof(buf))) > 0) {
     if (write(1, buf, n) != n) {
       printf(1, "cat: write error\n");
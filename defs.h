@@ -7,12 +7,17 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct inodeops;
+struct iovec;
+struct mntent;
+struct page;
 struct pipe;
 struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
 struct stat;
+struct super;
 struct superblock;
 
 //#define true 1
@@ -23,7 +28,10 @@ typedef enum{false,true} bool;
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
+void            brelsecold(struct buf*);
 void            bwrite(struct buf*);
+void            bwritedata(uint, uint, char*);
+void            binval(uint);
 
 // console.c
 void            consoleinit(void);
@@ -33,6 +41,7 @@ void            panic(char*) __attribute__((noreturn));
 
 // exec.c
 int             exec(char*, char**);
+pde_t*          loadprog(struct proc*, char*, char**, uint*);
 
 // file.c
 struct file*    filealloc(void);
@@ -40,8 +49,14 @@ void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filepread(struct file*, char*, int n, uint);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filewritev(struct file*, struct iovec*, int);
+int             filesplice(struct file*, struct file*, int);
+int             filesync(struct file*, int);
+int             filepwrite(struct file*, char*, int n, uint);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -49,18 +64,29 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iget(uint, uint);
 void            iinit(int dev);
 void            ilock(struct inode*);
 void            iput(struct inode*);
+void            iflush(struct inode*);
+void            isync(struct inode*, int);
+int             idevref(uint);
+void            superinit(void);
+void            superalloc(uint, struct inodeops*);
+void            superfree(uint);
+struct super*   getsuper(uint);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
+struct inode*   nameimnt(char*, struct mntent**);
 int             readi(struct inode*, char*, uint, uint);
+int             readidirect(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
+int             writeidirect(struct inode*, char*, uint, uint);
 
 // ide.c
 void            ideinit(void);
@@ -75,6 +101,8 @@ void            ioapicinit(void);
 // kalloc.c
 char*           kalloc(void);
 void            kfree(char*);
+void            kref(char*);
+int             krefcount(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -87,12 +115,19 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(int, int);
+void            lapictick(int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
 // log.c
 void            initlog(int dev);
+void            initlooplog(int dev, struct superblock *sb);
 void            log_write(struct buf*);
+uint            log_seq(void);
+void            log_force(uint);
+void            log_bfree(uint, uint);
+int             log_isfreed(uint, uint);
 void            begin_op();
 void            end_op();
 
@@ -102,9 +137,20 @@ uint getorcreatedev(struct inode * ip);
 struct inode * getlloopdevi(uint devno);
 struct buf* loopdev_read(struct buf* b);
 void loopdev_write(struct buf* b);
+uint devdup(uint devno);
+int devref(uint devno);
 void devput(uint devno);
 void loopdevinit(void);
 
+// mmap.c
+uint            mmapbase(struct proc*);
+int             mmapcheck(uint, uint, int);
+void            mmapclear(struct proc*, pde_t*);
+int             mmapfault(uint, int);
+int             mmapfile(struct file*, uint, int, int, uint);
+int             mmapfork(struct proc*, struct proc*);
+int             munmapva(uint, uint);
+
 // mp.c
 extern int      ismp;
 void            mpinit(void);
@@ -113,18 +159,40 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// pagecache.c
+void            pcinit(void);
+struct page*    pcget(struct inode*, uint);
+void            pcinval(uint, uint);
+void            pcput(struct page*);
+int             pcread(struct inode*, char*, uint, uint);
+void            pcupdate(struct inode*, char*, uint, uint);
+int             pcwrite(struct inode*, char*, uint, uint);
+void            pcdirty(struct page*);
+int             pcflush(struct inode*, int);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
+int             pipereadbegin(struct pipe*, char**, int, int);
+void            pipereadend(struct pipe*, int);
+int             pipewritebegin(struct pipe*, char**, int);
+void            pipewriteend(struct pipe*, int, int);
+int             pipegetsize(struct pipe*);
+int             pipesetsize(struct pipe*, int);
 
 //PAGEBREAK: 16
 // proc.c
+int             clone(uint, uint, uint);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             futex(uint, int, int);
 int             growproc(int);
+void            pinuvm(uint, uint);
+void            unpinuvm(void);
+int             uvmbusy(uint, uint);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
@@ -132,10 +200,14 @@ void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             setaffinity(int, uint);
 void            setproc(struct proc*);
+int             setsched(int, int, int);
+int             spawn(char*, char**, struct file**, int);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
+int             waitpid(int, int*, int);
 void            wakeup(void*);
 void            yield(void);
 
@@ -168,7 +240,9 @@ char*           strncpy(char*, const char*, int);
 
 // syscall.c
 int             argint(int, int*);
+int             argiov(int, int, struct iovec*, int);
 int             argptr(int, char**, int);
+int             argwptr(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -178,8 +252,16 @@ void            syscall(void);
 void mountinit(void);
 struct mntent * mntdup(struct mntent * mntent);
 void mntput(struct mntent * mntent);
-struct mntent * mntlookup(struct inode * ip);
-struct inode * getmntpnt(uint devno);
+struct mntent * mntlookup(struct mntent * parent, struct inode * ip);
+struct mntent * mntcopylist(struct mntent * list, struct mntent * rootmnt, struct mntent ** prootmnt);
+
+// tmpfs.c
+int             istmpfsdev(uint);
+void            tmpfsinit(void);
+int             tmpfsalloc(void);
+uint            tmpfsdup(uint);
+void            tmpfsput(uint);
+int             tmpfsref(uint);
 
 // timer.c
 void            timerinit(void);
@@ -196,17 +278,25 @@ void            uartintr(void);
 void            uartputc(int);
 
 // vm.c
+uint*           walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
 void            seginit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
+int             shrinkuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(pde_t*, uint, int);
+int             cowpage(pde_t*, uint);
+int             cowfault(uint);
+int             cowcheck(uint, uint);
 void            switchuvm(struct proc*);
+void            tlbflush(pde_t*);
+void            tlbflushed(void);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
@@ -221,10 +311,21 @@ int alloc_new_pid(pid_namespace_struct* pid_ns);
 void remove_from_pid_namespace(pid_namespace_struct* pid_namespace);
 void init_pid_namespaces(void);
 
+// mnt_namespace.c
+typedef struct mnt_namespace mnt_namespace_struct;
+void init_mnt_namespaces(void);
+mnt_namespace_struct* create_root_mnt_namespace(void);
+mnt_namespace_struct* copy_mnt_namespace(mnt_namespace_struct* mnt_ns);
+mnt_namespace_struct* increase_mnt_namespace_count(mnt_namespace_struct* mnt_ns);
+void put_mnt_namespace(mnt_namespace_struct* mnt_ns);
+void unshare_mnt_list(mnt_namespace_struct* mnt_ns);
+struct mntent* get_mnt_namespace_root(mnt_namespace_struct* mnt_ns);
+
 // namespace.c
 #define PID_NS 0b00000001
+#define MNT_NS 0b00000010
 void ns_init(void);
-nsproxy_struct* create_nsproxy(pid_namespace_struct * pid_namespace, bool is_lock_required);
+nsproxy_struct* create_nsproxy(pid_namespace_struct * pid_namespace, mnt_namespace_struct * mnt_namespace, bool is_lock_required);
 void get_nsproxy(nsproxy_struct* nsproxy);
 int unshare(int flags);
 void put_nsproxy(nsproxy_struct* nsproxy);
@@ -6,9 +6,16 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "tgroup.h"
 
-int
-exec(char *path, char **argv)
+// Load the program at path into a new page table for p, with
+// the arguments argv on its stack. Sets p's name and the entry
+// point and stack pointer in p->tf, but leaves p's memory alone.
+// Returns the page table, and its size in *szp, or 0.
+pde_t*
+loadprog(struct proc *p, char *path, char **argv, uint *szp)
 {
   char *s, *last;
   int i, off;
@@ -16,15 +23,14 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
-  struct proc *curproc = myproc();
+  pde_t *pgdir;
 
   begin_op();
 
   if((ip = namei(path)) == 0){
     end_op();
     cprintf("exec: fail\n");
-    return -1;
+    return 0;
   }
   ilock(ip);
   pgdir = 0;
@@ -91,17 +97,12 @@ exec(char *path, char **argv)
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
-  safestrcpy(curproc->name, last, sizeof(curproc->name));
+  safestrcpy(p->name, last, sizeof(p->name));
 
-  // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
-  curproc->tf->eip = elf.entry;  // main
-  curproc->tf->esp = sp;
-  switchuvm(curproc);
-  freevm(oldpgdir);
-  return 0;
+  p->tf->eip = elf.entry;  // main
+  p->tf->esp = sp;
+  *szp = sz;
+  return pgdir;
 
  bad:
   if(pgdir)
@@ -110,5 +111,29 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
-  return -1;
+  return 0;
+}
+
+int
+exec(char *path, char **argv)
+{
+  uint sz;
+  pde_t *pgdir, *oldpgdir;
+  struct proc *curproc = myproc();
+
+  // The other threads would lose their memory.
+  if(curproc->tg->ref > 1)
+    return -1;
+
+  if((pgdir = loadprog(curproc, path, argv, &sz)) == 0)
+    return -1;
+
+  // Commit to the user image.
+  oldpgdir = curproc->pgdir;
+  curproc->pgdir = pgdir;
+  curproc->tg->sz = sz;
+  switchuvm(curproc);
+  mmapclear(curproc, oldpgdir);
+  freevm(oldpgdir);
+  return 0;
 }
@@ -2,3 +2,10 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+#define O_DIRECT  0x400  // file data bypasses the page and buffer caches
+
+// fcntl() commands
+#define F_GETPIPE_SZ 1  // size of a pipe's buffer
+#define F_SETPIPE_SZ 2  // resize a pipe's buffer, rounded up to pages
+
+#define PIPEMAXSIZE (64*4096)  // largest pipe buffer
@@ -9,6 +9,7 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -32,6 +33,7 @@ filealloc(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
+      f->direct = 0;
       release(&ftable.lock);
       return f;
     }
@@ -92,66 +94,323 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
-// Read from file f.
-int
-fileread(struct file *f, char *addr, int n)
+// Read from f at *off into the segments of iov, advancing *off.
+// Stops at the first short read. A pipe has no offset, and
+// fills only the first non-empty segment so as not to block
+// once some data has arrived.
+static int
+readiov(struct file *f, struct iovec *iov, int iovcnt, uint *off)
 {
-  int r;
+  int i, r, tot;
 
   if(f->readable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+  if(f->type == FD_PIPE){
+    for(i = 0; i < iovcnt; i++)
+      if(iov[i].iov_len > 0)
+        return piperead(f->pipe, iov[i].iov_base, iov[i].iov_len);
+    return 0;
+  }
   if(f->type == FD_INODE){
+    tot = 0;
+    if(f->direct)
+      iflush(f->ip);
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
+    for(i = 0; i < iovcnt; i++){
+      if(f->direct)
+        r = readidirect(f->ip, iov[i].iov_base, *off, iov[i].iov_len);
+      else
+        r = readi(f->ip, iov[i].iov_base, *off, iov[i].iov_len);
+      if(r > 0){
+        *off += r;
+        tot += r;
+      }
+      if(r < 0 && tot == 0)
+        tot = -1;
+      if(r != iov[i].iov_len)
+        break;
+    }
     iunlock(f->ip);
-    return r;
+    return tot;
   }
   panic("fileread");
 }
 
 //PAGEBREAK!
-// Write to file f.
-int
-filewrite(struct file *f, char *addr, int n)
+// Write the segments of iov to f at *off, advancing *off.
+static int
+writeiov(struct file *f, struct iovec *iov, int iovcnt, uint *off)
 {
-  int r;
+  int i, r, tot;
 
   if(f->writable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+  if(f->type == FD_PIPE){
+    tot = 0;
+    for(i = 0; i < iovcnt; i++){
+      if((r = pipewrite(f->pipe, iov[i].iov_base, iov[i].iov_len)) < 0)
+        return -1;
+      tot += r;
+    }
+    return tot;
+  }
   if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
+    // the segments land back to back, so small ones
+    // share a transaction up to the same limit. O_DIRECT
+    // writes don't log their data, and stop short when the
+    // transaction has no room left for new blocks.
+    int max = f->direct ? MAXFILE*BSIZE : MAXOPBYTES;
+    uint done = 0;  // bytes of iov[i] already written
+    int n1 = 0;
+    int flushed = 0;
+    if(f->direct)
+      iflush(f->ip);
+    i = 0;
+    tot = 0;
+    r = 0;
+    while(i < iovcnt){
+      int room = max;
 
       begin_op();
       ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
+      while(i < iovcnt && room > 0){
+        n1 = iov[i].iov_len - done;
+        if(n1 > room)
+          n1 = room;
+        if(f->direct)
+          r = writeidirect(f->ip, (char*)iov[i].iov_base + done, *off, n1);
+        else
+          r = writei(f->ip, (char*)iov[i].iov_base + done, *off, n1);
+        if(r > 0){
+          *off += r;
+          room -= r;
+          tot += r;
+          done += r;
+        }
+        if(done == iov[i].iov_len){
+          i++;
+          done = 0;
+        }
+        if(r != n1)
+          break;
+      }
       iunlock(f->ip);
       end_op();
 
       if(r < 0)
         break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
+      if(r != n1){
+        // the page cache is full of dirty pages, or an
+        // O_DIRECT write has used up the transaction
+        if(r == 0 && flushed)
+          break;
+        iflush(f->ip);
+        flushed = 1;
+      } else {
+        flushed = 0;
+      }
     }
-    return i == n ? n : -1;
+    iflush(f->ip);
+    return i == iovcnt ? tot : -1;
   }
   panic("filewrite");
 }
 
+// Read from file f.
+int
+fileread(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return readiov(f, &iov, 1, &f->off);
+}
+
+// Write to file f.
+int
+filewrite(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return writeiov(f, &iov, 1, &f->off);
+}
+
+// Read from file f into several buffers.
+int
+filereadv(struct file *f, struct iovec *iov, int iovcnt)
+{
+  return readiov(f, iov, iovcnt, &f->off);
+}
+
+// Write several buffers to file f.
+int
+filewritev(struct file *f, struct iovec *iov, int iovcnt)
+{
+  return writeiov(f, iov, iovcnt, &f->off);
+}
+
+// Read from file f at offset off, leaving f->off alone.
+int
+filepread(struct file *f, char *addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->type != FD_INODE)
+    return -1;
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return readiov(f, &iov, 1, &off);
+}
+
+// Write to file f at offset off, leaving f->off alone.
+int
+filepwrite(struct file *f, char *addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->type != FD_INODE)
+    return -1;
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return writeiov(f, &iov, 1, &off);
+}
+
+
+// Make what was written to f durable: its data and inode, or if
+// datasync only what is needed to read the data back.
+int
+filesync(struct file *f, int datasync)
+{
+  if(f->type != FD_INODE)
+    return -1;
+  iflush(f->ip);
+  isync(f->ip, datasync);
+  return 0;
+}
+
+//PAGEBREAK!
+// Copy from file f at f->off straight into pipe p.
+static int
+splicetopipe(struct file *f, struct pipe *p, int n)
+{
+  int tot, m, r;
+  char *addr;
+
+  for(tot = 0; tot < n; tot += r){
+    if((m = pipewritebegin(p, &addr, n - tot)) < 0)
+      return tot > 0 ? tot : -1;
+    ilock(f->ip);
+    if((r = readi(f->ip, addr, f->off, m)) > 0)
+      f->off += r;
+    iunlock(f->ip);
+    pipewriteend(p, r > 0 ? r : 0, r < m || tot + r == n);
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    if(r < m){
+      tot += r;
+      break;  // end of file
+    }
+  }
+  return tot;
+}
+
+// Copy from pipe p straight into file f at f->off. Waits for
+// data only until some has been moved, like piperead.
+static int
+splicefrompipe(struct pipe *p, struct file *f, int n)
+{
+  int tot, m, r;
+  char *addr;
+
+  for(tot = 0; tot < n; tot += r){
+    m = n - tot;
+    if(m > MAXOPBYTES)
+      m = MAXOPBYTES;
+    if((m = pipereadbegin(p, &addr, m, tot == 0)) <= 0){
+      if(tot == 0)
+        tot = m;
+      break;
+    }
+    begin_op();
+    ilock(f->ip);
+    if((r = writei(f->ip, addr, f->off, m)) > 0)
+      f->off += r;
+    iunlock(f->ip);
+    end_op();
+    pipereadend(p, r > 0 ? r : 0);
+    if(r != m){
+      // an error, or the page cache is full of dirty pages
+      if(r > 0)
+        tot += r;
+      else if(tot == 0)
+        tot = -1;
+      break;
+    }
+  }
+  iflush(f->ip);
+  return tot;
+}
+
+// Copy between two inodes through a kernel page.
+static int
+splicefile(struct file *in, struct file *out, int n)
+{
+  int tot, m, r, w;
+  char *page;
+
+  if((page = kalloc()) == 0)
+    return -1;
+  r = w = 0;
+  for(tot = 0; tot < n; tot += w){
+    m = n - tot;
+    if(m > MAXOPBYTES)
+      m = MAXOPBYTES;
+    ilock(in->ip);
+    if((r = readi(in->ip, page, in->off, m)) > 0)
+      in->off += r;
+    iunlock(in->ip);
+    if(r <= 0)
+      break;
+    begin_op();
+    ilock(out->ip);
+    if((w = writei(out->ip, page, out->off, r)) > 0)
+      out->off += w;
+    iunlock(out->ip);
+    end_op();
+    if(w != r){
+      // an error, or the page cache is full of dirty pages
+      if(w > 0)
+        tot += w;
+      in->off -= r - (w > 0 ? w : 0);
+      break;
+    }
+    if(r < m){
+      tot += w;
+      break;  // end of file, or a device read returned early
+    }
+  }
+  kfree(page);
+  iflush(out->ip);
+  if(tot == 0 && (r < 0 || w < 0))
+    return -1;
+  return tot;
+}
+
+// Move up to n bytes from in to out without a user buffer.
+// Either side may be a pipe, but not both.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type == FD_INODE && out->type == FD_PIPE)
+    return splicetopipe(in, out->pipe, n);
+  if(in->type == FD_PIPE && out->type == FD_INODE)
+    return splicefrompipe(in->pipe, out, n);
+  if(in->type == FD_INODE && out->type == FD_INODE)
+    return splicefile(in, out, n);
+  return -1;
+}
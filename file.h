@@ -3,17 +3,26 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char direct;  // O_DIRECT: bypass the caches for file data
   struct pipe *pipe;
   struct inode *ip;
   uint off;
 };
 
+// Most bytes to write to a file in one transaction: a few blocks
+// at a time to avoid exceeding the maximum log transaction size,
+// including i-node, indirect block, allocation blocks,
+// and 2 blocks of slop for non-aligned writes.
+#define MAXOPBYTES (((MAXOPBLOCKS-1-1-2) / 2) * 512)
+
 
 // in-memory copy of an inode
 struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  int mounted;        // Number of mounts on this inode, guarded by gmnt.lock
+  struct super *sp;   // File system the inode belongs to
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -22,7 +31,11 @@ struct inode {
   short minor;
   short nlink;
   uint size;
+  uint dsize;         // size on disk; less than size until writeback
   uint addrs[NDIRECT+1];
+
+  uint seq;           // log transaction that last updated the inode
+  uint dataseq;       // ... that last changed its size or blocks
 };
 
 // table mapping major device number to
@@ -17,17 +17,15 @@
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "tgroup.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
 #include "sysmount.h"
+#include "vfs.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
-static void itrunc(struct inode*);
-// there should be one superblock per disk device, but we run with
-// only one device
-struct superblock sb; 
-
+static struct super* xv6super(struct super*);
 // Read the super block.
 void
 readsb(int dev, struct superblock *sb)
@@ -53,23 +51,37 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Allocate a disk block on the file system of sp: the first
+// free one at or after goal, wrapping around to the start,
+// that the open transaction hasn't freed (see log_bfree).
+// The block is not zeroed.
 static uint
-balloc(uint dev)
+ballocnear(struct super *sp, uint goal)
 {
-  int b, bi, m;
+  int b, bi, m, i, nbmap;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+  acquire(&sp->lock);
+  if(sp->nfreeblocks == 0)
+    panic("balloc: out of blocks");
+  release(&sp->lock);
+  if(goal >= sp->sb.size)
+    goal = 0;
+
+  nbmap = (sp->sb.size + BPB - 1) / BPB;
+  for(i = 0; i <= nbmap; i++){
+    b = (goal / BPB + i) % nbmap * BPB;
+    bp = bread(sp->dev, BBLOCK(b, sp->sb));
+    for(bi = i == 0 ? goal % BPB : 0; bi < BPB && b + bi < sp->sb.size; bi++){
       m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
+      if((bp->data[bi/8] & m) == 0 && !log_isfreed(sp->dev, b + bi)){  // Is block free?
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
+        acquire(&sp->lock);
+        sp->nfreeblocks--;
+        sp->bhint = b + bi;
+        release(&sp->lock);
         return b + bi;
       }
     }
@@ -78,14 +90,29 @@ balloc(uint dev)
   panic("balloc: out of blocks");
 }
 
+// Allocate a zeroed disk block on the file system of sp.
+// The search starts at the last allocation.
+static uint
+balloc(struct super *sp)
+{
+  uint b;
+
+  acquire(&sp->lock);
+  b = sp->bhint;
+  release(&sp->lock);
+  b = ballocnear(sp, b);
+  bzero(sp->dev, b);
+  return b;
+}
+
 // Free a disk block.
 static void
-bfree(int dev, uint b)
+bfree(struct super *sp, uint b)
 {
   struct buf *bp;
   int bi, m;
 
-  bp = bread(dev, BBLOCK(b, sb));
+  bp = bread(sp->dev, BBLOCK(b, sp->sb));
   bi = b % BPB;
   m = 1 << (bi % 8);
   if((bp->data[bi/8] & m) == 0)
@@ -93,6 +120,10 @@ bfree(int dev, uint b)
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
+  log_bfree(sp->dev, b);
+  acquire(&sp->lock);
+  sp->nfreeblocks++;
+  release(&sp->lock);
 }
 
 // Inodes.
@@ -179,35 +210,170 @@ iinit(int dev)
     initsleeplock(&icache.inode[i].lock, "inode");
   }
 
-  readsb(dev, &sb);
+  struct super *sp = xv6super(getsuper(dev));
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
- inodestart %d bmap start %d\n", sb.size, sb.nblocks,
-          sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
-          sb.bmapstart);
+ inodestart %d bmap start %d free blocks %d free inodes %d\n",
+          sp->sb.size, sp->sb.nblocks, sp->sb.ninodes, sp->sb.nlog,
+          sp->sb.logstart, sp->sb.inodestart, sp->sb.bmapstart,
+          sp->nfreeblocks, sp->nfreeinodes);
 }
 
-static struct inode* iget(uint dev, uint inum);
-
 //PAGEBREAK!
+// File systems.
+//
+// Each device holding a file system has an entry in the
+// super table, made when the device comes into use and freed
+// with it, which tells the generic inode code below how to
+// handle the device's inodes.
+
+struct {
+  struct spinlock lock;
+  struct super super[NSUPER];
+} supertable;
+
+// Set up the super table with the root file system.
+void
+superinit(void)
+{
+  struct super *sp;
+
+  initlock(&supertable.lock, "super");
+  for(sp = supertable.super; sp < &supertable.super[NSUPER]; sp++){
+    initsleeplock(&sp->loadlock, "superload");
+    initlock(&sp->lock, "super");
+  }
+  superalloc(ROOTDEV, &xv6fsops);
+}
+
+// Record that device dev holds a file system with inode operations ops.
+void
+superalloc(uint dev, struct inodeops *ops)
+{
+  struct super *sp;
+
+  acquire(&supertable.lock);
+  for(sp = supertable.super; sp < &supertable.super[NSUPER]; sp++){
+    if(sp->ops == 0){
+      sp->dev = dev;
+      sp->ops = ops;
+      sp->valid = 0;
+      release(&supertable.lock);
+      return;
+    }
+  }
+  panic("superalloc: no supers");
+}
+
+// Forget the file system on device dev. No inode of the
+// device may be referenced any more.
+void
+superfree(uint dev)
+{
+  struct super *sp = getsuper(dev);
+
+  pcinval(dev, 0);
+  acquire(&supertable.lock);
+  sp->ops = 0;
+  release(&supertable.lock);
+}
+
+struct super*
+getsuper(uint dev)
+{
+  struct super *sp;
+
+  acquire(&supertable.lock);
+  for(sp = supertable.super; sp < &supertable.super[NSUPER]; sp++){
+    if(sp->ops && sp->dev == dev){
+      release(&supertable.lock);
+      return sp;
+    }
+  }
+  panic("getsuper: no file system on device");
+}
+
+// Load the superblock of an xv6 file system the first time it is
+// needed and count its free blocks and inodes, so that later
+// allocations can give up or start searching without reading it.
+// Returns sp.
+static struct super*
+xv6super(struct super *sp)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  uint b, bi, inum;
+
+  if(sp->valid)
+    return sp;
+
+  acquiresleep(&sp->loadlock);
+  if(!sp->valid){
+    readsb(sp->dev, &sp->sb);
+    sp->nfreeblocks = 0;
+    for(b = 0; b < sp->sb.size; b += BPB){
+      bp = bread(sp->dev, BBLOCK(b, sp->sb));
+      for(bi = 0; bi < BPB && b + bi < sp->sb.size; bi++)
+        if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+          sp->nfreeblocks++;
+      brelse(bp);
+    }
+    sp->nfreeinodes = 0;
+    for(inum = 1; inum < sp->sb.ninodes; inum++){
+      bp = bread(sp->dev, IBLOCK(inum, sp->sb));
+      dip = (struct dinode*)bp->data + inum%IPB;
+      if(dip->type == 0)
+        sp->nfreeinodes++;
+      brelse(bp);
+    }
+    sp->bhint = 0;
+    sp->ihint = 1;
+    if(isloopdev(sp->dev))
+      initlooplog(sp->dev, &sp->sb);
+    sp->valid = 1;
+  }
+  releasesleep(&sp->loadlock);
+  return sp;
+}
+
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
 // Returns an unlocked but allocated and referenced inode.
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  struct super *sp = getsuper(dev);
+  return sp->ops->ialloc(sp, type);
+}
+
+// The search starts at the last inode allocated or freed.
+static struct inode*
+xv6ialloc(struct super *sp, short type)
+{
+  int inum, i, start;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
+  xv6super(sp);
+  acquire(&sp->lock);
+  if(sp->nfreeinodes == 0)
+    panic("ialloc: no inodes");
+  start = sp->ihint;
+  release(&sp->lock);
+
+  for(i = 0; i < sp->sb.ninodes - 1; i++){
+    inum = (start - 1 + i) % (sp->sb.ninodes - 1) + 1;
+    bp = bread(sp->dev, IBLOCK(inum, sp->sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
-      return iget(dev, inum);
+      acquire(&sp->lock);
+      sp->nfreeinodes--;
+      sp->ihint = inum;
+      release(&sp->lock);
+      return iget(sp->dev, inum);
     }
     brelse(bp);
   }
@@ -220,29 +386,48 @@ ialloc(uint dev, short type)
 // Caller must hold ip->lock.
 void
 iupdate(struct inode *ip)
+{
+  ip->sp->ops->iupdate(ip);
+}
+
+static void
+xv6iupdate(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
 
-  bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+  bp = bread(ip->dev, IBLOCK(ip->inum, ip->sp->sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
+  if(dip->type != 0 && ip->type == 0){
+    // iput() is freeing the inode
+    acquire(&ip->sp->lock);
+    ip->sp->nfreeinodes++;
+    ip->sp->ihint = ip->inum;
+    release(&ip->sp->lock);
+  }
   dip->type = ip->type;
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
-  dip->size = ip->size;
+  dip->size = ip->dsize;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
   log_write(bp);
   brelse(bp);
+  ip->seq = log_seq();
 }
 
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode*
+struct inode*
 iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
+  uint seq;
+
+  // Changes made while the inode was last cached may not have
+  // committed yet; assume they are in the open transaction.
+  seq = log_seq();
 
   acquire(&icache.lock);
 
@@ -267,6 +452,8 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->seq = ip->dataseq = seq;
+  ip->sp = getsuper(dev);
   release(&icache.lock);
 
   return ip;
@@ -283,29 +470,52 @@ idup(struct inode *ip)
   return ip;
 }
 
+// Total number of references to cached inodes of device dev.
+int
+idevref(uint dev)
+{
+  struct inode *ip;
+  int n = 0;
+
+  acquire(&icache.lock);
+  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++)
+    if(ip->ref > 0 && ip->dev == dev)
+      n += ip->ref;
+  release(&icache.lock);
+  return n;
+}
+
+// Read an inode from disk.
+static void
+xv6iload(struct inode *ip)
+{
+  struct buf *bp;
+  struct dinode *dip;
+
+  bp = bread(ip->dev, IBLOCK(ip->inum, xv6super(ip->sp)->sb));
+  dip = (struct dinode*)bp->data + ip->inum%IPB;
+  ip->type = dip->type;
+  ip->major = dip->major;
+  ip->minor = dip->minor;
+  ip->nlink = dip->nlink;
+  ip->size = dip->size;
+  ip->dsize = dip->size;
+  memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+  brelse(bp);
+}
+
 // Lock the given inode.
 // Reads the inode from disk if necessary.
 void
 ilock(struct inode *ip)
 {
-  struct buf *bp;
-  struct dinode *dip;
-
   if(ip == 0 || ip->ref < 1)
     panic("ilock");
 
   acquiresleep(&ip->lock);
 
   if(ip->valid == 0){
-    bp = bread(ip->dev, IBLOCK(ip->inum, sb));
-    dip = (struct dinode*)bp->data + ip->inum%IPB;
-    ip->type = dip->type;
-    ip->major = dip->major;
-    ip->minor = dip->minor;
-    ip->nlink = dip->nlink;
-    ip->size = dip->size;
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
-    brelse(bp);
+    ip->sp->ops->iload(ip);
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -339,7 +549,8 @@ iput(struct inode *ip)
     release(&icache.lock);
     if(r == 1){
       // inode has no links and no other references: truncate and free.
-      itrunc(ip);
+      ip->sp->ops->itrunc(ip);
+      pcinval(ip->dev, ip->inum);
       ip->type = 0;
       iupdate(ip);
       ip->valid = 0;
@@ -362,6 +573,40 @@ iput(struct inode *ip)
   release(&icache.lock);
 }
 
+// Write the data of ip that is only in the page cache back to
+// disk, in as many transactions as its new blocks need.
+// Caller must not hold ip->lock or be inside a transaction.
+void
+iflush(struct inode *ip)
+{
+  int more;
+
+  if(!ip->sp->ops->pagecache)
+    return;
+  do {
+    begin_op();
+    ilock(ip);
+    more = ip->type == T_FILE && pcflush(ip, 1) > 0;
+    iunlock(ip);
+    end_op();
+  } while(more);
+}
+
+// Return once the changes to ip are committed: all of them, or
+// if datasync only those needed to read its data back, its size
+// and blocks. Caller must not hold ip->lock or be inside a
+// transaction, and should iflush first.
+void
+isync(struct inode *ip, int datasync)
+{
+  uint seq;
+
+  ilock(ip);
+  seq = datasync ? ip->dataseq : ip->seq;
+  iunlock(ip);
+  log_force(seq);
+}
+
 // Common idiom: unlock, then put.
 void
 iunlockput(struct inode *ip)
@@ -388,7 +633,7 @@ bmap(struct inode *ip, uint bn)
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = balloc(ip->sp);
     return addr;
   }
   bn -= NDIRECT;
@@ -396,11 +641,11 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+      ip->addrs[NDIRECT] = addr = balloc(ip->sp);
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
+      a[bn] = addr = balloc(ip->sp);
       log_write(bp);
     }
     brelse(bp);
@@ -410,13 +655,93 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Return the disk block address of the nth block in inode ip,
+// or 0 if it has none.
+static uint
+bmapget(struct inode *ip, uint bn)
+{
+  uint addr;
+  struct buf *bp;
+
+  if(bn < NDIRECT)
+    return ip->addrs[bn];
+  bn -= NDIRECT;
+
+  if(bn < NINDIRECT){
+    if((addr = ip->addrs[NDIRECT]) == 0)
+      return 0;
+    bp = bread(ip->dev, addr);
+    addr = ((uint*)bp->data)[bn];
+    brelse(bp);
+    return addr;
+  }
+
+  panic("bmap: out of range");
+}
+
+// Count a block allocated in the transaction of room against
+// its log space, which holds its bitmap block.
+static void
+roombmap(struct super *sp, struct wbroom *room, uint b)
+{
+  if(BBLOCK(b, sp->sb) != room->lastbmap){
+    room->left--;
+    room->lastbmap = BBLOCK(b, sp->sb);
+  }
+}
+
+// Allocate the nth block of ip, which has none, for writeback,
+// right after the block before it when that is free. The block
+// is not zeroed: the caller writes it before the allocation
+// commits. Returns 0 if the transaction of room could run out
+// of log space.
+static uint
+bmapnew(struct inode *ip, uint bn, struct wbroom *room)
+{
+  uint need, goal, addr;
+  struct buf *bp;
+
+  need = 1;  // a bitmap block
+  if(bn >= NDIRECT && !room->indirect)
+    need += ip->addrs[NDIRECT] ? 1 : 2;  // the indirect block, its bitmap block
+  if(room->left < need)
+    return 0;
+  if(bn == 0 || (goal = bmapget(ip, bn - 1)) == 0)
+    goal = ip->sp->bhint;
+  else
+    goal++;
+
+  if(bn < NDIRECT){
+    ip->addrs[bn] = addr = ballocnear(ip->sp, goal);
+    roombmap(ip->sp, room, addr);
+    return addr;
+  }
+  bn -= NDIRECT;
+
+  if(ip->addrs[NDIRECT] == 0){
+    ip->addrs[NDIRECT] = balloc(ip->sp);
+    roombmap(ip->sp, room, ip->addrs[NDIRECT]);
+  }
+  if(!room->indirect){
+    room->left--;
+    room->indirect = 1;
+  }
+  addr = ballocnear(ip->sp, goal);
+  roombmap(ip->sp, room, addr);
+  bp = bread(ip->dev, ip->addrs[NDIRECT]);
+  ((uint*)bp->data)[bn] = addr;
+  log_write(bp);
+  brelse(bp);
+  return addr;
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
 // and has no in-memory reference to it (is
 // not an open file or current directory).
 static void
-itrunc(struct inode *ip)
+xv6itrunc(struct inode *ip)
 {
   int i, j;
   struct buf *bp;
@@ -424,7 +749,7 @@ itrunc(struct inode *ip)
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
+      bfree(ip->sp, ip->addrs[i]);
       ip->addrs[i] = 0;
     }
   }
@@ -434,14 +759,15 @@ itrunc(struct inode *ip)
     a = (uint*)bp->data;
     for(j = 0; j < NINDIRECT; j++){
       if(a[j])
-        bfree(ip->dev, a[j]);
+        bfree(ip->sp, a[j]);
     }
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
+    bfree(ip->sp, ip->addrs[NDIRECT]);
     ip->addrs[NDIRECT] = 0;
   }
 
   ip->size = 0;
+  ip->dsize = 0;
   iupdate(ip);
 }
 
@@ -449,6 +775,12 @@ itrunc(struct inode *ip)
 // Caller must hold ip->lock.
 void
 stati(struct inode *ip, struct stat *st)
+{
+  ip->sp->ops->stati(ip, st);
+}
+
+static void
+xv6stati(struct inode *ip, struct stat *st)
 {
   st->dev = ip->dev;
   st->ino = ip->inum;
@@ -463,14 +795,21 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
-
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
       return -1;
     return devsw[ip->major].read(ip, dst, n);
   }
+  if(ip->type == T_FILE && ip->sp->ops->pagecache)
+    return pcread(ip, dst, off, n);
+  return ip->sp->ops->readi(ip, dst, off, n);
+}
+
+static int
+xv6readi(struct inode *ip, char *dst, uint off, uint n)
+{
+  uint tot, m, b;
+  struct buf *bp;
 
   if(off > ip->size || off + n < off)
     return -1;
@@ -478,28 +817,49 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
+    if((b = bmapget(ip, off/BSIZE)) == 0){
+      memset(dst, 0, m);  // not written back yet
+      continue;
+    }
+    bp = bread(ip->dev, b);
     memmove(dst, bp->data + off%BSIZE, m);
-    brelse(bp);
+    if(ip->type == T_FILE)
+      brelsecold(bp);
+    else
+      brelse(bp);
   }
   return n;
 }
 
 // PAGEBREAK!
 // Write data to inode.
+// Regular files of file systems that use the page cache are
+// only written into the cache, and may come up short when it
+// is full; iflush writes them back.
 // Caller must hold ip->lock.
 int
 writei(struct inode *ip, char *src, uint off, uint n)
 {
-  uint tot, m;
-  struct buf *bp;
+  int r;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].write)
       return -1;
     return devsw[ip->major].write(ip, src, n);
   }
+  if(ip->type == T_FILE && ip->sp->ops->pagecache)
+    return pcwrite(ip, src, off, n);
+  if((r = ip->sp->ops->writei(ip, src, off, n)) > 0)
+    pcupdate(ip, src, off, r);
+  return r;
+}
+
+static int
+xv6writei(struct inode *ip, char *src, uint off, uint n)
+{
+  uint tot, m;
+  struct buf *bp;
 
   if(off > ip->size || off + n < off)
     return -1;
@@ -516,11 +876,104 @@ writei(struct inode *ip, char *src, uint off, uint n)
 
   if(n > 0 && off > ip->size){
     ip->size = off;
+    ip->dsize = off;
     iupdate(ip);
+    ip->dataseq = ip->seq;
   }
   return n;
 }
 
+// Write the n bytes at data, a page of the page cache holding the
+// data of ip at off, to the file's blocks in place rather than
+// through the log. The caller's transaction commits after the
+// data is on disk, so blocks it allocates never expose old data.
+// If room is set, missing blocks are allocated as long as the
+// transaction has log space left; otherwise they are skipped.
+// Returns -1 if any block was missing.
+static int
+xv6writepage(struct inode *ip, char *data, uint off, uint n, struct wbroom *room)
+{
+  uint bn, end, b;
+  int r = 0;
+
+  end = (off + n + BSIZE - 1) / BSIZE;
+  for(bn = off / BSIZE; bn < end; bn++, data += BSIZE){
+    if((b = bmapget(ip, bn)) == 0 && (room == 0 || (b = bmapnew(ip, bn, room)) == 0)){
+      r = -1;
+      continue;
+    }
+    bwritedata(ip->dev, b, data);
+  }
+  return r;
+}
+
+// Read from ip around the page cache, for O_DIRECT.
+// Caller must hold ip->lock, and should have flushed ip.
+int
+readidirect(struct inode *ip, char *dst, uint off, uint n)
+{
+  if(ip->type != T_FILE || !ip->sp->ops->pagecache)
+    return readi(ip, dst, off, n);
+  return ip->sp->ops->readi(ip, dst, off, n);
+}
+
+// Write to ip straight to its blocks, around the page cache, for
+// O_DIRECT. off must be a multiple of BSIZE, and so must n unless
+// the write reaches the end of the file. Allocates blocks as long
+// as the caller's transaction has room, and stops short when it
+// runs out. Caller must hold ip->lock, and should have flushed ip.
+int
+writeidirect(struct inode *ip, char *src, uint off, uint n)
+{
+  struct wbroom room;
+  char tail[BSIZE];
+  char *data;
+  uint tot, m;
+  int grew;
+
+  if(ip->type != T_FILE || !ip->sp->ops->pagecache)
+    return writei(ip, src, off, n);
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > MAXFILE*BSIZE)
+    return -1;
+  if(off % BSIZE != 0 || (n % BSIZE != 0 && off + n < ip->size))
+    return -1;
+
+  room.left = MAXOPBLOCKS - 1;  // the inode's block
+  room.lastbmap = 0;
+  room.indirect = 0;
+  for(tot=0; tot<n; tot+=m){
+    m = min(n - tot, BSIZE);
+    data = src + tot;
+    if(m < BSIZE){
+      // the end of the file: don't read past the caller's data
+      memset(tail, 0, BSIZE);
+      memmove(tail, data, m);
+      data = tail;
+    }
+    if(ip->sp->ops->writepage(ip, data, off + tot, m, &room) < 0)
+      break;
+  }
+  if(tot == 0)
+    return 0;
+
+  pcupdate(ip, src, off, tot);
+  grew = 0;
+  if(off + tot > ip->size){
+    if(ip->dsize == ip->size){
+      ip->dsize = off + tot;
+      grew = 1;
+    }
+    ip->size = off + tot;
+  }
+  if(room.left < MAXOPBLOCKS - 1 || grew){
+    iupdate(ip);
+    ip->dataseq = ip->seq;
+  }
+  return tot;
+}
+
 //PAGEBREAK!
 // Directories
 
@@ -535,11 +988,16 @@ namecmp(const char *s, const char *t)
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
-  struct dirent de;
-
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
+  return dp->sp->ops->dirlookup(dp, name, poff);
+}
+
+static struct inode*
+xv6dirlookup(struct inode *dp, char *name, uint *poff)
+{
+  uint off, inum;
+  struct dirent de;
 
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
@@ -558,6 +1016,19 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   return 0;
 }
 
+struct inodeops xv6fsops = {
+  .ialloc = xv6ialloc,
+  .iload = xv6iload,
+  .iupdate = xv6iupdate,
+  .itrunc = xv6itrunc,
+  .readi = xv6readi,
+  .writei = xv6writei,
+  .dirlookup = xv6dirlookup,
+  .stati = xv6stati,
+  .writepage = xv6writepage,
+  .pagecache = 1,
+};
+
 // Write a new directory entry (name, inum) into the directory dp.
 int
 dirlink(struct inode *dp, char *name, uint inum)
@@ -631,79 +1102,86 @@ skipelem(char *path, char *name)
 // Look up and return the inode for a path name.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
+// The lookup carries the mount the current inode belongs to, so
+// stepping onto a mounted tree or back out of it through ".." is a
+// pointer dereference rather than a search of the mount list.
+// If pmp != 0, the mount of the returned inode is stored there
+// with a reference the caller must mntput().
 // Must be called inside a transaction since it calls iput().
 static struct inode*
-namex(char *path, int nameiparent, char *name)
+namex(char *path, int nameiparent, char *name, struct mntent **pmp)
 {
-  
   struct inode *ip, *next;
-  // struct mntent *mp;
+  struct mntent *mp, *nextmp;
 
   if(*path == '/') {
-    ip = iget(ROOTDEV, ROOTINO);
-    // mp = mntdup(gmnt.prootmnt);
+    mp = get_mnt_namespace_root(myproc()->nsproxy->mnt_ns);
+    ip = idup(mp->rooti);
   } else {
-    ip = idup(myproc()->cwd);
-    // mp = mntdup(myproc()->cwdmnt);
+    // another thread may chdir() meanwhile
+    acquire(&myproc()->tg->lock);
+    mp = mntdup(myproc()->tg->cwdmnt);
+    ip = idup(myproc()->tg->cwd);
+    release(&myproc()->tg->lock);
   }
 
-  // TODO: finish namex
-
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
     if(ip->type != T_DIR){
-      // mntput(mp);
       iunlockput(ip);
+      mntput(mp);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      // mntput(mp);
       iunlock(ip);
+      if(pmp)
+        *pmp = mp;
+      else
+        mntput(mp);
       return ip;
     }
-    
-    // TODO: when ..  next locked, but ip unlocked
-    if (isloopdev(ip->dev) && ip->inum == ROOTINO && namecmp(name, "..") == 0) {
-      struct inode * mnti = idup(getmntpnt(ip->dev));
-      iunlock(ip);
-      iput(ip);
-      ip = mnti;
-      ilock(ip);
-      if(ip->type != T_DIR) {
-        panic("dirlookup not DIR");
+
+    // ".." at the root of a mounted tree continues from its mount point.
+    if(namecmp(name, "..") == 0){
+      while(ip == mp->rooti && mp->parent != 0){
+        iunlockput(ip);
+        ip = idup(mp->mnti);
+        nextmp = mntdup(mp->parent);
+        mntput(mp);
+        mp = nextmp;
+        ilock(ip);
       }
     }
 
     if((next = dirlookup(ip, name, 0)) == 0){
-      // mntput(mp);
       iunlockput(ip);
+      mntput(mp);
       return 0;
     }
+    iunlockput(ip);
 
-
-    struct mntent * nextmp;
-    if ((nextmp = mntlookup(next)) != 0) {
-      uint newdevno = nextmp->devno;
-      
+    // Step onto whatever is mounted on next. Only inodes that are
+    // mount points somewhere pay for the mount list search.
+    while(next->mounted && (nextmp = mntlookup(mp, next)) != 0){
       iput(next);
-      next = iget(newdevno, ROOTINO); 
-      
-      mntput(nextmp);
-      // mp = nextmp;
+      next = idup(nextmp->rooti);
+      mntput(mp);
+      mp = nextmp;
     }
-
-    iunlockput(ip);
     ip = next;
   }
 
-  // mntput(mp);
-
   if(nameiparent){
     iput(ip);
+    mntput(mp);
     return 0;
   }
 
+  if(pmp)
+    *pmp = mp;
+  else
+    mntput(mp);
   return ip;
 }
 
@@ -711,11 +1189,19 @@ struct inode*
 namei(char *path)
 {
   char name[DIRSIZ];
-  return namex(path, 0, name);
+  return namex(path, 0, name, 0);
+}
+
+// Like namei, but also return the mount the inode was found in.
+struct inode*
+nameimnt(char *path, struct mntent **pmp)
+{
+  char name[DIRSIZ];
+  return namex(path, 0, name, pmp);
 }
 
 struct inode*
 nameiparent(char *path, char *name)
 {
-  return namex(path, 1, name);
+  return namex(path, 1, name, 0);
 }
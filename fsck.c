@@ -0,0 +1,342 @@
+// fsck.xv6: check an xv6 file system image, either the root fs.img
+// or a loop image, from the host.
+//
+// The image is memory-mapped. A committed but uninstalled log is
+// replayed first, like the kernel does at boot. Then threads walk
+// disjoint ranges of the inode table, recording which blocks each
+// inode uses and how many directory entries point at each inode.
+// Finally the collected state is compared with the bitmap and with
+// the inodes' link counts.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define stat xv6_stat  // avoid clash with host struct stat
+#define dirent xv6_dirent  // avoid clash with host struct dirent
+#include "types.h"
+#include "fs.h"
+#include "stat.h"
+#include "param.h"
+#undef stat
+#undef dirent
+#include <sys/stat.h>
+
+#define MAXTHREADS 64
+
+// Contents of the log header block, as in log.c.
+struct logheader {
+  int n;
+  int block[LOGSIZE];
+};
+
+uchar *img;
+uint imgblocks;
+struct superblock sb;
+uint datastart;   // first block after the bitmap
+int nthreads;
+
+uint *blockowner; // inode using each block, 0 if none
+uint *nrefs;      // directory entries naming each inode, "." excluded
+int nerrors;
+
+pthread_mutex_t outlock = PTHREAD_MUTEX_INITIALIZER;
+
+void
+problem(const char *fmt, ...)
+{
+  va_list ap;
+
+  pthread_mutex_lock(&outlock);
+  nerrors++;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  pthread_mutex_unlock(&outlock);
+}
+
+uchar*
+block(uint b)
+{
+  return img + (size_t)b * BSIZE;
+}
+
+struct dinode*
+dinode(uint inum)
+{
+  return (struct dinode*)block(IBLOCK(inum, sb)) + inum % IPB;
+}
+
+int
+bitset(uint b)
+{
+  return (block(BBLOCK(b, sb))[(b % BPB) / 8] >> (b % 8)) & 1;
+}
+
+// Install committed log blocks to their home locations.
+// Returns the number of blocks installed.
+int
+replaylog(int readonly)
+{
+  struct logheader *lh = (struct logheader*)block(sb.logstart);
+  int i;
+
+  if(lh->n < 0 || lh->n > LOGSIZE || lh->n >= sb.nlog){
+    problem("log header has bad count %d", lh->n);
+    return 0;
+  }
+  for(i = 0; i < lh->n; i++){
+    if(lh->block[i] < sb.inodestart || lh->block[i] >= sb.size){
+      problem("log entry %d names bad block %d", i, lh->block[i]);
+      return 0;
+    }
+  }
+  for(i = 0; i < lh->n; i++)
+    memmove(block(lh->block[i]), block(sb.logstart + 1 + i), BSIZE);
+  i = lh->n;
+  if(!readonly)
+    lh->n = 0;
+  return i;
+}
+
+// Record that inode inum uses block b.
+void
+useblock(uint inum, uint b, const char *what)
+{
+  uint prev;
+
+  if(b < datastart || b >= sb.size){
+    problem("inode %u: %s block %u outside the data area", inum, what, b);
+    return;
+  }
+  prev = __sync_val_compare_and_swap(&blockowner[b], 0, inum);
+  if(prev != 0)
+    problem("inode %u: %s block %u already used by inode %u", inum, what, b, prev);
+}
+
+// Data block bn of inode dip, or 0.
+uint
+bmap(struct dinode *dip, uint bn)
+{
+  uint *a;
+
+  if(bn < NDIRECT)
+    return dip->addrs[bn];
+  if(dip->addrs[NDIRECT] == 0 || dip->addrs[NDIRECT] >= sb.size)
+    return 0;
+  a = (uint*)block(dip->addrs[NDIRECT]);
+  return a[bn - NDIRECT];
+}
+
+void
+checkdir(uint inum, struct dinode *dip)
+{
+  struct xv6_dirent *de;
+  uint off, b, seendot, seendotdot;
+
+  if(dip->size % sizeof(*de) != 0)
+    problem("directory %u: size %u is not a multiple of the entry size", inum, dip->size);
+  seendot = seendotdot = 0;
+  for(off = 0; off + sizeof(*de) <= dip->size; off += sizeof(*de)){
+    b = bmap(dip, off / BSIZE);
+    if(b < datastart || b >= sb.size)
+      continue;  // already reported
+    de = (struct xv6_dirent*)(block(b) + off % BSIZE);
+    if(de->inum == 0)
+      continue;
+    if(de->inum >= sb.ninodes){
+      problem("directory %u: entry %.*s names bad inode %u", inum, DIRSIZ, de->name, de->inum);
+      continue;
+    }
+    if(strncmp(de->name, ".", DIRSIZ) == 0){
+      seendot = 1;
+      if(de->inum != inum)
+        problem("directory %u: \".\" names inode %u", inum, de->inum);
+      continue;
+    }
+    if(strncmp(de->name, "..", DIRSIZ) == 0)
+      seendotdot = 1;
+    __sync_fetch_and_add(&nrefs[de->inum], 1);
+  }
+  if(!seendot || !seendotdot)
+    problem("directory %u: missing \".\" or \"..\"", inum);
+}
+
+// Check inodes [lo, hi).
+void*
+checkinodes(void *arg)
+{
+  uint *range = arg;
+  uint inum, bn, nb, b, *a, i;
+  struct dinode *dip;
+
+  for(inum = range[0]; inum < range[1]; inum++){
+    dip = dinode(inum);
+    if(dip->type == 0)
+      continue;
+    if(dip->type != T_DIR && dip->type != T_FILE && dip->type != T_DEV){
+      problem("inode %u: bad type %d", inum, dip->type);
+      continue;
+    }
+    if(dip->type == T_DEV)
+      continue;
+    if(dip->size > MAXFILE * BSIZE){
+      problem("inode %u: size %u too large", inum, dip->size);
+      continue;
+    }
+    nb = (dip->size + BSIZE - 1) / BSIZE;
+    for(bn = 0; bn < NDIRECT; bn++){
+      if(dip->addrs[bn])
+        useblock(inum, dip->addrs[bn], "direct");
+      else if(bn < nb)
+        problem("inode %u: hole at block %u", inum, bn);
+    }
+    if(dip->addrs[NDIRECT]){
+      useblock(inum, dip->addrs[NDIRECT], "indirect");
+      if(dip->addrs[NDIRECT] < sb.size){
+        a = (uint*)block(dip->addrs[NDIRECT]);
+        for(i = 0; i < NINDIRECT; i++){
+          if(a[i])
+            useblock(inum, a[i], "data");
+          else if(NDIRECT + i < nb)
+            problem("inode %u: hole at block %u", inum, NDIRECT + i);
+        }
+      }
+    } else if(nb > NDIRECT){
+      problem("inode %u: size %u needs an indirect block", inum, dip->size);
+    }
+    if(dip->type == T_DIR){
+      for(bn = 0; bn < nb; bn++){
+        b = bmap(dip, bn);
+        if(b == 0 || b >= sb.size)
+          break;
+      }
+      if(bn == nb)
+        checkdir(inum, dip);
+    }
+  }
+  return 0;
+}
+
+void
+usage(void)
+{
+  fprintf(stderr, "Usage: fsck.xv6 [-n] [-j threads] image\n");
+  exit(2);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int c, fd, readonly, i, replayed;
+  struct stat st;
+  pthread_t threads[MAXTHREADS];
+  uint ranges[MAXTHREADS][2];
+  uint b, inum, per;
+  struct dinode *dip;
+
+  readonly = 0;
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  while((c = getopt(argc, argv, "nj:")) != -1){
+    switch(c){
+    case 'n':
+      readonly = 1;
+      break;
+    case 'j':
+      nthreads = atoi(optarg);
+      break;
+    default:
+      usage();
+    }
+  }
+  if(optind != argc - 1)
+    usage();
+  if(nthreads < 1)
+    nthreads = 1;
+  if(nthreads > MAXTHREADS)
+    nthreads = MAXTHREADS;
+
+  if((fd = open(argv[optind], readonly ? O_RDONLY : O_RDWR)) < 0 || fstat(fd, &st) < 0){
+    perror(argv[optind]);
+    exit(2);
+  }
+  imgblocks = st.st_size / BSIZE;
+  if(imgblocks < 2){
+    fprintf(stderr, "fsck.xv6: %s is too small\n", argv[optind]);
+    exit(2);
+  }
+  // A read-only check still replays the log, into a private copy.
+  img = mmap(0, st.st_size, PROT_READ|PROT_WRITE, readonly ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+  if(img == MAP_FAILED){
+    perror("mmap");
+    exit(2);
+  }
+
+  memmove(&sb, block(1), sizeof(sb));
+  datastart = sb.bmapstart + sb.size / BPB + 1;
+  if(sb.size > imgblocks || sb.ninodes == 0 || sb.logstart != 2 ||
+     sb.inodestart != sb.logstart + sb.nlog ||
+     sb.bmapstart != sb.inodestart + sb.ninodes / IPB + 1 ||
+     datastart > sb.size){
+    fprintf(stderr, "fsck.xv6: bad superblock: size %u ninodes %u nlog %u logstart %u inodestart %u bmapstart %u\n",
+            sb.size, sb.ninodes, sb.nlog, sb.logstart, sb.inodestart, sb.bmapstart);
+    exit(2);
+  }
+
+  replayed = replaylog(readonly);
+  if(replayed)
+    printf("replayed %d log blocks\n", replayed);
+
+  blockowner = calloc(sb.size, sizeof(uint));
+  nrefs = calloc(sb.ninodes, sizeof(uint));
+
+  if(dinode(ROOTINO)->type != T_DIR)
+    problem("root inode is not a directory");
+
+  per = (sb.ninodes + nthreads - 1) / nthreads;
+  for(i = 0; i < nthreads; i++){
+    ranges[i][0] = i * per < 1 ? 1 : i * per;
+    ranges[i][1] = (i + 1) * per > sb.ninodes ? sb.ninodes : (i + 1) * per;
+    if(pthread_create(&threads[i], 0, checkinodes, ranges[i]) != 0){
+      perror("pthread_create");
+      exit(2);
+    }
+  }
+  for(i = 0; i < nthreads; i++)
+    pthread_join(threads[i], 0);
+
+  for(b = 0; b < sb.size; b++){
+    if(b < datastart && !bitset(b))
+      problem("metadata block %u not marked in use", b);
+    else if(b >= datastart && blockowner[b] && !bitset(b))
+      problem("block %u used by inode %u but marked free", b, blockowner[b]);
+    else if(b >= datastart && !blockowner[b] && bitset(b))
+      problem("block %u marked in use but not used", b);
+  }
+
+  for(inum = 1; inum < sb.ninodes; inum++){
+    dip = dinode(inum);
+    if(dip->type == 0){
+      if(nrefs[inum])
+        problem("free inode %u named by %u directory entries", inum, nrefs[inum]);
+      continue;
+    }
+    if(nrefs[inum] == 0)
+      problem("inode %u is not named by any directory", inum);
+    else if(dip->nlink != nrefs[inum])
+      problem("inode %u: nlink %d but named %u times", inum, dip->nlink, nrefs[inum]);
+  }
+
+  if(!readonly && msync(img, st.st_size, MS_SYNC) < 0){
+    perror("msync");
+    exit(2);
+  }
+  printf("%s: %u blocks, %u inodes, %d problems\n", argv[optind], sb.size, sb.ninodes, nerrors);
+  exit(nerrors ? 1 : 0);
+}
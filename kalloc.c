@@ -21,6 +21,7 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  ushort ref[PHYSTOP/PGSIZE];  // References to each allocated page
 } kmem;
 
 // Initialization happens in two phases.
@@ -52,10 +53,11 @@ freerange(void *vstart, void *vend)
     kfree(p);
 }
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last one.
+// (The exception is when initializing the allocator; see
+// kinit above.)
 void
 kfree(char *v)
 {
@@ -64,6 +66,18 @@ kfree(char *v)
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] > 1){
+    kmem.ref[V2P(v)/PGSIZE]--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  kmem.ref[V2P(v)/PGSIZE] = 0;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
@@ -87,10 +101,38 @@ kalloc(void)
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.ref[V2P(r)/PGSIZE] = 1;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
+// Add a reference to the allocated page at v, for
+// sharing it copy-on-write. kfree() drops it.
+void
+kref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kref");
+  acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] == 0)
+    panic("kref: free page");
+  kmem.ref[V2P(v)/PGSIZE]++;
+  release(&kmem.lock);
+}
+
+// Number of references to the allocated page at v.
+int
+krefcount(char *v)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.ref[V2P(v)/PGSIZE];
+  release(&kmem.lock);
+  return n;
+}
+
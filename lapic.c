@@ -113,6 +113,28 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Start or stop this CPU's clock tick.
+void
+lapictick(int on)
+{
+  if(lapic)
+    lapicw(TIMER, (on ? 0 : MASKED) | PERIODIC | (T_IRQ0 + IRQ_TIMER));
+}
+
+// Send interrupt vector to the CPU with the given APIC ID.
+void
+lapicipi(int apicid, int vector)
+{
+  if(!lapic)
+    return;
+  pushcli();  // an interrupt handler might send one too
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+  popcli();
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -22,6 +22,13 @@
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
 //
+// Commits are asynchronous: the last outstanding end_op()
+// commits only if the log is close to full, the transaction
+// has been open for COMMITTICKS, or log_force() asked for it,
+// as fsync does. Until then later system calls join the same
+// transaction. A loop image's log still commits at the end of
+// every operation, since the image may be unmounted at any time.
+//
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
@@ -47,9 +54,12 @@ initlog(int dev)
   struct superblock sb;
   initlock(&log.lock, "log");
   readsb(dev, &sb);
+  if(sb.size > FSSIZE)
+    panic("initlog: file system too big");
   log.start = sb.logstart;
   log.size = sb.nlog;
   log.dev = dev;
+  log.seq = 1;
 
   loop_log.start = sb.logstart;
   loop_log.size = sb.nlog;
@@ -58,6 +68,20 @@ initlog(int dev)
   recover_from_log();
 }
 
+// Take the log geometry of a loop image from its own superblock
+// when the image is first used.
+void
+initlooplog(int dev, struct superblock *sb)
+{
+  if(sb->size > FSSIZE)
+    panic("initlooplog: file system too big");
+  acquire(&log.lock);
+  loop_log.start = sb->logstart;
+  loop_log.size = sb->nlog;
+  loop_log.dev = dev;
+  release(&log.lock);
+}
+
 // Copy committed blocks from log to their home location
 static void
 install_trans(void)
@@ -192,23 +216,45 @@ begin_op(void)
   }
 }
 
+// Commit the open transaction. Caller holds log.lock, and
+// no FS system calls are outstanding.
+static void
+commitlocked(void)
+{
+  log.committing = 1;
+  loop_log.committing = 1;
+  // call commit w/o holding locks, since not allowed
+  // to sleep with locks.
+  release(&log.lock);
+  commit();
+  acquire(&log.lock);
+  log.committing = 0;
+  loop_log.committing = 0;
+  log.seq++;
+  log.force = 0;
+  log.lastcommit = ticks;
+  memset(log.freed, 0, sizeof(log.freed));
+  memset(loop_log.freed, 0, sizeof(loop_log.freed));
+  wakeup(&log);
+}
+
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation
+// and the transaction shouldn't stay open any longer.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
   loop_log.outstanding -= 1; // should be the same as log.outstanding
 
   if(log.committing || loop_log.committing)
     panic("log is committing");
-  if(log.outstanding == 0 && loop_log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-    loop_log.committing = 1;
+  if(log.outstanding == 0 && loop_log.outstanding == 0 &&
+     (log.force || log.lh.n + MAXOPBLOCKS > LOGSIZE ||
+      (is_loop_mounted && loop_log.lh.n > 0) ||
+      ticks - log.lastcommit >= COMMITTICKS)){
+    commitlocked();
   } else {
     // begin_op() may be waiting for log space,
     // and decrementing log.outstanding has decreased
@@ -216,17 +262,65 @@ end_op(void)
     wakeup(&log);
   }
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    loop_log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+// The number of the open transaction, which the log_write()s
+// of the current FS system call are part of.
+uint
+log_seq(void)
+{
+  uint seq;
+
+  acquire(&log.lock);
+  seq = log.seq;
+  release(&log.lock);
+  return seq;
+}
+
+// Return once transaction seq has committed, committing it
+// now if it is still open. Must not be called inside a
+// transaction.
+void
+log_force(uint seq)
+{
+  acquire(&log.lock);
+  while(log.seq == seq){
+    if(log.outstanding == 0 && !log.committing){
+      commitlocked();
+      break;
+    }
+    log.force = 1;
+    sleep(&log, &log.lock);
   }
+  release(&log.lock);
+}
+
+// Record that the open transaction freed block b of dev.
+// On disk the block still belongs to its old owner until the
+// transaction commits, so it must not be reused before then:
+// file data is written to its block directly, not through the
+// log, and a crash would leave the old owner pointing at it.
+void
+log_bfree(uint dev, uint b)
+{
+  struct log *l = isloopdev(dev) ? &loop_log : &log;
+
+  acquire(&log.lock);
+  l->freed[b/8] |= 1 << (b%8);
+  release(&log.lock);
+}
+
+// Has the open transaction freed block b of dev?
+int
+log_isfreed(uint dev, uint b)
+{
+  struct log *l = isloopdev(dev) ? &loop_log : &log;
+  int r;
+
+  acquire(&log.lock);
+  r = (l->freed[b/8] >> (b%8)) & 1;
+  release(&log.lock);
+  return r;
 }
 
 // Copy modified blocks from cache to log.
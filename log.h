@@ -13,7 +13,11 @@ struct log {
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
   int dev;
+  uint seq;        // number of the open transaction
+  int force;       // commit when the outstanding ops end
+  uint lastcommit; // ticks at the last commit
   struct logheader lh;
+  uchar freed[FSSIZE/8+1]; // blocks bfree()d by the open transaction
 };
 
 struct log log;
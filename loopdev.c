@@ -7,6 +7,7 @@
 #include "buf.h"
 #include "loopdev.h"
 #include "log.h"
+#include "vfs.h"
 
 // TODO: persist to disk
 struct {
@@ -36,11 +37,12 @@ uint getorcreatedev(struct inode * ip) {
   struct loopdev * freeloopdev = 0;
   uint freeloopdevno = 0;
   for (uint i = 0; i < NLOOPDEV; i++) {
-    if (!freeloopdev && !gloopdev.loopdevtable[i].used) {
+    if (!freeloopdev && !gloopdev.loopdevtable[i].ref) {
       freeloopdev = &gloopdev.loopdevtable[i];
       freeloopdevno = i;
     }
-    if (gloopdev.loopdevtable[i].used && gloopdev.loopdevtable[i].ip == ip) {
+    if (gloopdev.loopdevtable[i].ref && gloopdev.loopdevtable[i].ip == ip) {
+      gloopdev.loopdevtable[i].ref++;
       release(&gloopdev.lock);
       return i | LOOPDEV_MASK;
     }
@@ -48,21 +50,65 @@ uint getorcreatedev(struct inode * ip) {
   if (freeloopdev == 0) {
     panic("[getorcreatedev] no free loop device");
   }
-  freeloopdev->used = 1;
+  freeloopdev->ref = 1;
+  is_loop_mounted = 1;
   release(&gloopdev.lock);
 
   freeloopdev->ip = idup(ip);
+  superalloc(freeloopdevno | LOOPDEV_MASK, &xv6fsops);
   return freeloopdevno | LOOPDEV_MASK;
 }
 
+// Take another reference to a loop device that is already in use.
+uint devdup(uint devno) {
+  if (!isloopdev(devno)) {
+    panic("[devdup] devno is not a loop device");
+  }
+  struct loopdev * ld = &gloopdev.loopdevtable[devno & (~LOOPDEV_MASK)];
+  acquire(&gloopdev.lock);
+  if (ld->ref < 1) {
+    panic("[devdup] loop device is not in use");
+  }
+  ld->ref++;
+  release(&gloopdev.lock);
+  return devno;
+}
+
+// Number of mounts using a loop device.
+int devref(uint devno) {
+  struct loopdev * ld = &gloopdev.loopdevtable[devno & (~LOOPDEV_MASK)];
+  acquire(&gloopdev.lock);
+  int ref = ld->ref;
+  release(&gloopdev.lock);
+  return ref;
+}
+
+// Drop a reference to a loop device. The last one releases the
+// backing inode and forgets the device's cached blocks, so a later
+// image on the same device number cannot see them.
+// Must be called inside a transaction since it calls iput().
 void devput(uint devno) {
   if (!isloopdev(devno)) {
     panic("[devput] devno is not a loop device");
   }
   uint loopdevno = devno & (~LOOPDEV_MASK);
+  struct loopdev * ld = &gloopdev.loopdevtable[loopdevno];
   acquire(&gloopdev.lock);
-  gloopdev.loopdevtable[loopdevno].used = 0;  
+  if (ld->ref < 1) {
+    panic("[devput] loop device is not in use");
+  }
+  if (--ld->ref > 0) {
+    release(&gloopdev.lock);
+    return;
+  }
+  struct inode * ip = ld->ip;
+  ld->ip = 0;
+  is_loop_mounted = 0;
+  binval(devno);
   release(&gloopdev.lock);
+
+  superfree(devno);
+  iput(ip);
 }
 
 struct buf* loopdev_read(struct buf* b) {
@@ -82,22 +128,29 @@ struct buf* loopdev_read(struct buf* b) {
 }
 
 void loopdev_write(struct buf* b) {
-//  begin_op();
-//  is_loop_mounted = 0;
-  log.outstanding++;
   uint devno = b->dev; 
   uint blockno = b->blockno;
   struct inode * ip = getlloopdevi(devno);
-  writei(ip, (char*) b->data, blockno * BSIZE, BSIZE);
+  // The image's blocks all exist, so its dirty pages can be
+  // written back in place without the log. That works both while
+  // the log commits and when file data written back to the image
+  // arrives from inside a transaction.
+  ilock(ip);
+  if (writei(ip, (char*) b->data, blockno * BSIZE, BSIZE) == BSIZE) {
+    pcflush(ip, 0);
+  } else {
+    // The page cache is full of dirty pages: write through the log,
+    // posing as a FS system call in case it is committing.
+    log.outstanding++;
+    if (ip->sp->ops->writei(ip, (char*) b->data, blockno * BSIZE, BSIZE) != BSIZE) {
+      panic("[loopdev_write] loopdev_write didn't write a whole block");
+    }
+    pcupdate(ip, (char*) b->data, blockno * BSIZE, BSIZE);
+    log.outstanding--;
+  }
+  iunlock(ip);
   b->flags |= B_VALID;
   b->flags &= ~B_DIRTY;
-
-  log.outstanding--;
-  if (log.outstanding != 0) {
-    panic("[loopdev_write] trick failed"); // log should not be access by any other processes
-  }
-//  is_loop_mounted = 1;
-//  end_op();
 }
 
 
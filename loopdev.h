@@ -3,7 +3,7 @@
 #define LOOPDEV_MASKBIT 5
 
 struct loopdev {
-  int used;
+  int ref;  // number of mounts using this device, 0 if free
   struct inode * ip;
 };
 
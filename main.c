@@ -29,16 +29,18 @@ main(void)
   pinit();         // process table
   tvinit();        // trap vectors
   binit();         // buffer cache
+  pcinit();        // page cache
   fileinit();      // file table
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
   loopdevinit();   // loop device
+  tmpfsinit();     // in-memory file systems
+  superinit();     // file system table, with the root disk
   mountinit();     // init global mount data structure
+  ns_init();       // namespace tables
   userinit();      // first user process
   mpmain();        // finish this processor's setup
-
-  ns_init();
 }
 
 // Other CPUs jump here from entryother.S.
@@ -4,41 +4,65 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #define stat xv6_stat  // avoid clash with host struct stat
+#define dirent xv6_dirent  // avoid clash with host struct dirent
 #include "types.h"
 #include "fs.h"
 #include "stat.h"
 #include "param.h"
+#undef stat
+#undef dirent
+#include <sys/stat.h>
 
 #ifndef static_assert
 #define static_assert(a, b) do { switch (0) case 0: case (a): ; } while (0)
 #endif
 
 #define NINODES 200
+#define NTHREADS 4
 
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+//
+// The image is built in a memory mapping of the output file. Inodes
+// and directories are written in place and the bitmap once at the
+// end. Every file and directory gets one contiguous run of data
+// blocks, preceded by its indirect block if it needs one. File
+// contents are copied in by NTHREADS threads once the layout is done.
 
 int ninodeblocks = NINODES / IPB + 1;
 int nlog = LOGSIZE;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
+int fsize;    // Size of the image in blocks
 
-int fsfd;
+uchar *img;
+char *imgpath;  // Output file, once created
 struct superblock sb;
-char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
 
+// A file whose contents still have to be copied into the image.
+struct copyjob {
+  char *path;
+  uint inum;
+  uint start;  // first data block
+  uint size;   // bytes
+};
+struct copyjob *jobs;
+int njobs, maxjobs;
+int nextjob;
 
 void balloc(int);
-void wsect(uint, void*);
-void winode(uint, struct dinode*);
-void rinode(uint inum, struct dinode *ip);
-void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
-void iappend(uint inum, void *p, int n);
+uint ilayout(uint inum, uint size);
+void iwrite(uint inum, void *p, uint n);
+void adddir(uint inum, uint parentinum, char *hostdir, char **files, int nfiles);
+void copyfiles(void);
 
 // convert to intel byte order
 ushort
@@ -63,29 +87,57 @@ xint(uint x)
   return y;
 }
 
+// Exit after an error, removing the part-built image so that
+// make doesn't take it for a finished one.
+void
+die(void)
+{
+  if(imgpath)
+    unlink(imgpath);
+  exit(1);
+}
+
+void
+usage(void)
+{
+  fprintf(stderr, "Usage: mkfs [-s blocks] [-d dir] is_loopdev_image fs.img files...\n");
+  exit(1);
+}
+
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
-  uint rootino, inum;
-//  uint off;
-  struct dirent de;
-  char buf[BSIZE];
-//  struct dinode din;
-
+  int c, fsfd;
+  uint rootino;
+  char *dir = 0;
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
-  if(argc < 3){
-    fprintf(stderr, "Usage: mkfs is_loopdev_image fs.img files...\n");
-    exit(1);
+  assert((BSIZE % sizeof(struct dinode)) == 0);
+  assert((BSIZE % sizeof(struct xv6_dirent)) == 0);
+
+  fsize = 0;
+  while((c = getopt(argc, argv, "s:d:")) != -1){
+    switch(c){
+    case 's':
+      fsize = atoi(optarg);
+      break;
+    case 'd':
+      dir = optarg;
+      break;
+    default:
+      usage();
+    }
   }
+  argc -= optind - 1;
+  argv += optind - 1;
 
-  assert((BSIZE % sizeof(struct dinode)) == 0);
-  assert((BSIZE % sizeof(struct dirent)) == 0);
+  if(argc < 3)
+    usage();
 
   int is_loopdev_image = strcmp(argv[1], "1") == 0 ? 1 : 0;
-  int fsize = is_loopdev_image ? 100 : FSSIZE;
+  if(fsize == 0)
+    fsize = is_loopdev_image ? 100 : FSSIZE;
   int nbitmap = fsize/(BSIZE*8) + 1;
 
   fsfd = open(argv[2], O_RDWR|O_CREAT|O_TRUNC, 0666);
@@ -93,10 +145,25 @@ main(int argc, char *argv[])
     perror(argv[2]);
     exit(1);
   }
+  imgpath = argv[2];
+  // a fresh file reads as zeroes, so there is nothing to clear
+  if(ftruncate(fsfd, (off_t)fsize * BSIZE) < 0){
+    perror("ftruncate");
+    die();
+  }
+  img = mmap(0, (size_t)fsize * BSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fsfd, 0);
+  if(img == MAP_FAILED){
+    perror("mmap");
+    die();
+  }
 
   // 1 fs block = 1 disk sector
   nmeta = 2 + nlog + ninodeblocks + nbitmap;
   nblocks = fsize - nmeta;
+  if(nblocks <= 0){
+    fprintf(stderr, "mkfs: %d blocks is too small\n", fsize);
+    die();
+  }
 
   sb.size = xint(fsize);
   sb.nblocks = xint(nblocks);
@@ -111,191 +178,271 @@ main(int argc, char *argv[])
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < fsize; i++)
-    wsect(i, zeroes);
-
-  memset(buf, 0, sizeof(buf));
-  memmove(buf, &sb, sizeof(sb));
-  wsect(1, buf);
+  memmove(img + BSIZE, &sb, sizeof(sb));
 
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
+  adddir(rootino, rootino, dir, argv + 3, argc - 3);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
-
-  for(i = 3; i < argc; i++){
-    assert(index(argv[i], '/') == 0);
-
-    if((fd = open(argv[i], 0)) < 0){
-      perror(argv[i]);
-      exit(1);
-    }
-
-    // Skip leading _ in name when writing to file system.
-    // The binaries are named _rm, _cat, etc. to keep the
-    // build operating system from trying to execute them
-    // in place of system binaries like rm and cat.
-    if(argv[i][0] == '_')
-      ++argv[i];
-
-    inum = ialloc(T_FILE);
-
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, argv[i], DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
-
-    while((cc = read(fd, buf, sizeof(buf))) > 0)
-      iappend(inum, buf, cc);
-
-    close(fd);
-  }
-
-//  // fix size of root inode dir
-//  rinode(rootino, &din);
-//  off = xint(din.size);
-//  off = ((off/BSIZE) + 1) * BSIZE;
-//  din.size = xint(off);
-//  winode(rootino, &din);
-
+  copyfiles();
   balloc(freeblock);
 
+  if(munmap(img, (size_t)fsize * BSIZE) < 0){
+    perror("munmap");
+    die();
+  }
+  close(fsfd);
   exit(0);
 }
 
-void
-wsect(uint sec, void *buf)
+// The on-disk inode inum, in the image.
+struct dinode*
+dinode(uint inum)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE){
-    perror("lseek");
-    exit(1);
-  }
-  if(write(fsfd, buf, BSIZE) != BSIZE){
-    perror("write");
-    exit(1);
-  }
+  assert(inum < NINODES);
+  return (struct dinode*)(img + IBLOCK(inum, sb) * BSIZE) + (inum % IPB);
 }
 
-void
-winode(uint inum, struct dinode *ip)
+uint
+ialloc(ushort type)
 {
-  char buf[BSIZE];
-  uint bn;
+  uint inum = freeinode++;
   struct dinode *dip;
 
-  bn = IBLOCK(inum, sb);
-  rsect(bn, buf);
-  dip = ((struct dinode*)buf) + (inum % IPB);
-  *dip = *ip;
-  wsect(bn, buf);
+  if(inum >= NINODES){
+    fprintf(stderr, "mkfs: out of inodes\n");
+    die();
+  }
+  dip = dinode(inum);
+  bzero(dip, sizeof(*dip));
+  dip->type = xshort(type);
+  dip->nlink = xshort(1);
+  dip->size = xint(0);
+  return inum;
 }
 
 void
-rinode(uint inum, struct dinode *ip)
+balloc(int used)
 {
-  char buf[BSIZE];
-  uint bn;
-  struct dinode *dip;
+  int i;
+  uchar *bitmap = img + sb.bmapstart * BSIZE;
 
-  bn = IBLOCK(inum, sb);
-  rsect(bn, buf);
-  dip = ((struct dinode*)buf) + (inum % IPB);
-  *ip = *dip;
+  printf("balloc: first %d blocks have been allocated\n", used);
+  assert(used <= fsize);
+  for(i = 0; i < used; i++)
+    bitmap[i/8] |= 0x1 << (i%8);
+  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
 }
 
-void
-rsect(uint sec, void *buf)
+// Give inode inum a contiguous run of data blocks for size bytes,
+// after its indirect block if it needs one. Returns the first data block.
+uint
+ilayout(uint inum, uint size)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE){
-    perror("lseek");
-    exit(1);
+  struct dinode *dip = dinode(inum);
+  uint nb = (size + BSIZE - 1) / BSIZE;
+  uint *indirect;
+  uint i, start;
+
+  if(nb > MAXFILE){
+    fprintf(stderr, "mkfs: file of %u bytes is too big\n", size);
+    die();
   }
-  if(read(fsfd, buf, BSIZE) != BSIZE){
-    perror("read");
-    exit(1);
+  if(freeblock + nb + (nb > NDIRECT) > fsize){
+    fprintf(stderr, "mkfs: out of blocks\n");
+    die();
+  }
+
+  indirect = 0;
+  if(nb > NDIRECT){
+    dip->addrs[NDIRECT] = xint(freeblock);
+    indirect = (uint*)(img + freeblock * BSIZE);
+    freeblock++;
+  }
+  start = freeblock;
+  for(i = 0; i < nb; i++){
+    if(i < NDIRECT)
+      dip->addrs[i] = xint(start + i);
+    else
+      indirect[i - NDIRECT] = xint(start + i);
   }
+  freeblock += nb;
+  dip->size = xint(size);
+  return start;
 }
 
-uint
-ialloc(ushort type)
+// Lay out inode inum and fill it with n bytes from p.
+void
+iwrite(uint inum, void *p, uint n)
 {
-  uint inum = freeinode++;
-  struct dinode din;
-
-  bzero(&din, sizeof(din));
-  din.type = xshort(type);
-  din.nlink = xshort(1);
-  din.size = xint(0);
-  winode(inum, &din);
-  return inum;
+  uint start = ilayout(inum, n);
+  memmove(img + start * BSIZE, p, n);
 }
 
+// A directory being filled in.
+struct dirbuild {
+  struct xv6_dirent *des;
+  int nde, maxde;
+  struct subdir {
+    uint inum;
+    char *path;
+  } *subs;
+  int nsub, maxsub;
+};
+
+// Add the host file or directory path to directory db as name.
+// Files are queued for copying and subdirectories for adddir(),
+// both to be laid out once the directory's own blocks are.
 void
-balloc(int used)
+addfile(struct dirbuild *db, char *path, char *name)
 {
-  uchar buf[BSIZE];
-  int i;
+  struct stat st;
+  struct xv6_dirent *de;
+  uint inum;
 
-  printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  if(stat(path, &st) < 0){
+    perror(path);
+    die();
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
-}
+  if(!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)){
+    fprintf(stderr, "mkfs: skipping %s, not a file or directory\n", path);
+    return;
+  }
+  if(strlen(name) > DIRSIZ)
+    fprintf(stderr, "mkfs: truncating name %s\n", name);
 
-#define min(a, b) ((a) < (b) ? (a) : (b))
+  inum = ialloc(S_ISDIR(st.st_mode) ? T_DIR : T_FILE);
+  if(db->nde == db->maxde){
+    db->maxde *= 2;
+    db->des = realloc(db->des, db->maxde * sizeof(*db->des));
+  }
+  de = &db->des[db->nde++];
+  bzero(de, sizeof(*de));
+  de->inum = xshort(inum);
+  strncpy(de->name, name, DIRSIZ);
+
+  if(S_ISDIR(st.st_mode)){
+    if(db->nsub == db->maxsub){
+      db->maxsub = db->maxsub ? db->maxsub * 2 : 8;
+      db->subs = realloc(db->subs, db->maxsub * sizeof(*db->subs));
+    }
+    db->subs[db->nsub].inum = inum;
+    db->subs[db->nsub].path = strdup(path);
+    db->nsub++;
+  } else {
+    if(njobs == maxjobs){
+      maxjobs = maxjobs ? maxjobs * 2 : 64;
+      jobs = realloc(jobs, maxjobs * sizeof(*jobs));
+    }
+    jobs[njobs].path = strdup(path);
+    jobs[njobs].inum = inum;
+    jobs[njobs].size = st.st_size;
+    njobs++;
+  }
+}
 
+// Fill in directory inum from the host directory hostdir, if any,
+// and the given files, then lay out everything below it.
 void
-iappend(uint inum, void *xp, int n)
+adddir(uint inum, uint parentinum, char *hostdir, char **files, int nfiles)
 {
-  char *p = (char*)xp;
-  uint fbn, off, n1;
-  struct dinode din;
-  char buf[BSIZE];
-  uint indirect[NINDIRECT];
-  uint x;
-
-  rinode(inum, &din);
-  off = xint(din.size);
-  // printf("append inum %d at off %d sz %d\n", inum, off, n);
-  while(n > 0){
-    fbn = off / BSIZE;
-    assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
+  struct dirbuild db;
+  struct dinode *dip;
+  int i, firstjob, lastjob;
+  DIR *d;
+  struct dirent *hde;
+  char path[4096];
+  char *name;
+
+  bzero(&db, sizeof(db));
+  db.maxde = 16;
+  db.des = calloc(db.maxde, sizeof(*db.des));
+  db.des[0].inum = xshort(inum);
+  strcpy(db.des[0].name, ".");
+  db.des[1].inum = xshort(parentinum);
+  strcpy(db.des[1].name, "..");
+  db.nde = 2;
+  firstjob = njobs;
+
+  for(i = 0; i < nfiles; i++){
+    assert(index(files[i], '/') == 0);
+    // Skip leading _ in name when writing to file system.
+    // The binaries are named _rm, _cat, etc. to keep the
+    // build operating system from trying to execute them
+    // in place of system binaries like rm and cat.
+    name = files[i][0] == '_' ? files[i] + 1 : files[i];
+    addfile(&db, files[i], name);
+  }
+
+  if(hostdir){
+    if((d = opendir(hostdir)) == 0){
+      perror(hostdir);
+      die();
+    }
+    while((hde = readdir(d)) != 0){
+      if(strcmp(hde->d_name, ".") == 0 || strcmp(hde->d_name, "..") == 0)
+        continue;
+      snprintf(path, sizeof(path), "%s/%s", hostdir, hde->d_name);
+      addfile(&db, path, hde->d_name);
+    }
+    closedir(d);
+  }
+
+  iwrite(inum, db.des, db.nde * sizeof(*db.des));
+  free(db.des);
+
+  // Files follow their directory; subdirectories follow those.
+  lastjob = njobs;
+  for(i = firstjob; i < lastjob; i++)
+    jobs[i].start = ilayout(jobs[i].inum, jobs[i].size);
+  for(i = 0; i < db.nsub; i++){
+    dip = dinode(inum);
+    dip->nlink = xshort(xshort(dip->nlink) + 1);  // the child's ".."
+    adddir(db.subs[i].inum, inum, db.subs[i].path, 0, 0);
+    free(db.subs[i].path);
+  }
+  free(db.subs);
+}
+
+void*
+copyworker(void *arg)
+{
+  int i, fd;
+  struct copyjob *j;
+  ssize_t cc;
+  uint off;
+
+  while((i = __sync_fetch_and_add(&nextjob, 1)) < njobs){
+    j = &jobs[i];
+    if((fd = open(j->path, O_RDONLY)) < 0){
+      perror(j->path);
+      die();
+    }
+    for(off = 0; off < j->size; off += cc){
+      cc = read(fd, img + j->start * BSIZE + off, j->size - off);
+      if(cc <= 0){
+        perror(j->path);
+        die();
       }
-      x = xint(indirect[fbn-NDIRECT]);
     }
-    n1 = min(n, (fbn + 1) * BSIZE - off);
-    rsect(x, buf);
-    bcopy(p, buf + off - (fbn * BSIZE), n1);
-    wsect(x, buf);
-    n -= n1;
-    off += n1;
-    p += n1;
+    close(fd);
   }
-  din.size = xint(off);
-  winode(inum, &din);
+  return 0;
+}
+
+// Copy the contents of all files into their blocks.
+void
+copyfiles(void)
+{
+  pthread_t threads[NTHREADS];
+  int i;
+
+  nextjob = 0;
+  for(i = 0; i < NTHREADS; i++)
+    if(pthread_create(&threads[i], 0, copyworker, 0) != 0){
+      perror("pthread_create");
+      die();
+    }
+  for(i = 0; i < NTHREADS; i++)
+    pthread_join(threads[i], 0);
 }
@@ -0,0 +1,371 @@
+//
+// Memory-mapped files.
+//
+// mmap() only records a struct vma in the process; pages are
+// mapped in when first touched, by the page fault handler, or by
+// argptr() when a mapped buffer is passed to a system call.
+// MAP_SHARED mappings map the file's page from the page cache
+// itself, so all processes mapping a file see the same memory,
+// and pages the process wrote to (PTE_D) are written back to the
+// file through the log when they are unmapped. MAP_PRIVATE
+// mappings get a copy of the page. Mappings are placed below
+// KERNBASE, growing down, and sbrk() may not grow into them.
+// The mappings belong to the thread group, and its vmlock
+// guards them.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "stat.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "tgroup.h"
+#include "fs.h"
+#include "file.h"
+#include "vfs.h"
+#include "page.h"
+#include "mman.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+// The mapping of p that contains va, or 0.
+static struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->tg->vmas; v < &p->tg->vmas[NVMA]; v++)
+    if(v->f && va >= v->start && va < v->end)
+      return v;
+  return 0;
+}
+
+// The lowest address mapped by p, or KERNBASE.
+uint
+mmapbase(struct proc *p)
+{
+  struct vma *v;
+  uint base = KERNBASE;
+
+  for(v = p->tg->vmas; v < &p->tg->vmas[NVMA]; v++)
+    if(v->f && v->start < base)
+      base = v->start;
+  return base;
+}
+
+// Map len bytes of f starting at offset off into the current
+// process. Returns the address of the mapping, or -1.
+int
+mmapfile(struct file *f, uint len, int prot, int flags, uint off)
+{
+  struct tgroup *tg = myproc()->tg;
+  struct vma *v, *free;
+  uint start;
+  int moved;
+
+  if(f->type != FD_INODE || f->ip->type != T_FILE || len == 0 ||
+     off % PGSIZE != 0 || (flags != MAP_SHARED && flags != MAP_PRIVATE))
+    return -1;
+  if(((prot & PROT_READ) && !f->readable) ||
+     ((prot & PROT_WRITE) && flags == MAP_SHARED && !f->writable))
+    return -1;
+  len = PGROUNDUP(len);
+
+  acquiresleep(&tg->vmlock);
+  free = 0;
+  for(v = tg->vmas; v < &tg->vmas[NVMA]; v++)
+    if(v->f == 0 && free == 0)
+      free = v;
+  if(free == 0)
+    goto bad;
+
+  // highest gap below KERNBASE that fits
+  start = KERNBASE - len;
+  do {
+    moved = 0;
+    for(v = tg->vmas; v < &tg->vmas[NVMA]; v++){
+      if(v->f && v->start < start + len && start < v->end){
+        if(v->start < len)
+          goto bad;
+        start = v->start - len;
+        moved = 1;
+      }
+    }
+  } while(moved);
+  if(start < PGROUNDUP(tg->sz))
+    goto bad;
+
+  free->start = start;
+  free->end = start + len;
+  free->off = off;
+  free->prot = prot;
+  free->flags = flags;
+  free->f = filedup(f);
+  releasesleep(&tg->vmlock);
+  return start;
+
+bad:
+  releasesleep(&tg->vmlock);
+  return -1;
+}
+
+// Write the part of shared page pg that is inside the file
+// back to the file: by marking it dirty in the page cache if the
+// file system writes back from it, else through the log.
+static void
+writeback(struct inode *ip, struct page *pg)
+{
+  uint k, n, m;
+
+  if(ip->sp->ops->pagecache){
+    ilock(ip);
+    if(pg->off < ip->size)
+      pcdirty(pg);
+    iunlock(ip);
+    iflush(ip);
+    return;
+  }
+  for(k = 0;; k += m){
+    begin_op();
+    ilock(ip);
+    n = ip->size > pg->off ? min(ip->size - pg->off, PGSIZE) : 0;
+    if(k >= n){
+      iunlock(ip);
+      end_op();
+      break;
+    }
+    m = min(n - k, MAXOPBYTES);
+    writei(ip, pg->data + k, pg->off + k, m);
+    iunlock(ip);
+    end_op();
+  }
+}
+
+// Remove the pages of v in [start, end) from pgdir. Pages are
+// marked not present first, and only freed once no TLB, of any
+// CPU running a thread, can still reach them.
+static void
+unmappages(pde_t *pgdir, struct vma *v, uint start, uint end)
+{
+  struct inode *ip = v->f->ip;
+  struct page *pg;
+  pte_t *pte;
+  uint va, pa;
+
+  for(va = start; va < end; va += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)va, 0)) == 0 || (*pte & PTE_P) == 0)
+      continue;
+    if(v->flags == MAP_SHARED && (*pte & PTE_D)){
+      ilock(ip);
+      pg = pcget(ip, v->off + (va - v->start));
+      iunlock(ip);
+      if(pg == 0 || V2P(pg->data) != PTE_ADDR(*pte))
+        panic("unmappages");
+      writeback(ip, pg);
+      pcput(pg);
+    }
+    *pte &= ~PTE_P;
+  }
+  tlbflush(pgdir);
+
+  for(va = start; va < end; va += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)va, 0)) == 0 || PTE_ADDR(*pte) == 0)
+      continue;
+    pa = PTE_ADDR(*pte);
+    *pte = 0;
+    if(v->flags == MAP_PRIVATE){
+      kfree(P2V(pa));
+      continue;
+    }
+    // the mapping holds a reference; look the page up again
+    ilock(ip);
+    pg = pcget(ip, v->off + (va - v->start));
+    iunlock(ip);
+    if(pg == 0 || V2P(pg->data) != pa)
+      panic("unmappages");
+    pcput(pg);
+    pcput(pg);
+  }
+}
+
+// Unmap [addr, addr+len) from the current process. The range must
+// be a whole mapping or cover one end of it.
+int
+munmapva(uint addr, uint len)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+  uint end;
+
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  end = PGROUNDUP(addr + len);
+again:
+  acquiresleep(&curproc->tg->vmlock);
+  if((v = findvma(curproc, addr)) == 0 || end > v->end ||
+     (addr != v->start && end != v->end)){
+    releasesleep(&curproc->tg->vmlock);
+    return -1;
+  }
+  if(uvmbusy(addr, end))
+    goto again;
+
+  unmappages(curproc->pgdir, v, addr, end);
+  if(addr == v->start){
+    v->off += end - addr;
+    v->start = end;
+  } else
+    v->end = addr;
+  if(v->start == v->end){
+    fileclose(v->f);
+    v->f = 0;
+  }
+  releasesleep(&curproc->tg->vmlock);
+  return 0;
+}
+
+// Remove all mappings of p from pgdir, at exit or exec.
+void
+mmapclear(struct proc *p, pde_t *pgdir)
+{
+  struct vma *v;
+
+  for(v = p->tg->vmas; v < &p->tg->vmas[NVMA]; v++){
+    if(v->f){
+      unmappages(pgdir, v, v->start, v->end);
+      fileclose(v->f);
+      v->f = 0;
+    }
+  }
+}
+
+// Give child np the mappings of p. Shared pages already mapped
+// are mapped into the child too; private ones are copied. The
+// caller holds p's vmlock.
+int
+mmapfork(struct proc *np, struct proc *p)
+{
+  struct vma *v, *nv;
+  struct page *pg;
+  pte_t *pte;
+  uint va, pa;
+  char *mem;
+
+  for(v = p->tg->vmas, nv = np->tg->vmas; v < &p->tg->vmas[NVMA]; v++, nv++){
+    nv->f = 0;
+    if(v->f == 0)
+      continue;
+    *nv = *v;
+    nv->f = filedup(v->f);
+    for(va = v->start; va < v->end; va += PGSIZE){
+      if((pte = walkpgdir(p->pgdir, (char*)va, 0)) == 0 || (*pte & PTE_P) == 0)
+        continue;
+      pa = PTE_ADDR(*pte);
+      pg = 0;
+      mem = 0;
+      if(v->flags == MAP_SHARED){
+        ilock(v->f->ip);
+        pg = pcget(v->f->ip, v->off + (va - v->start));
+        iunlock(v->f->ip);
+        if(pg == 0)
+          return -1;
+      } else {
+        if((mem = kalloc()) == 0)
+          return -1;
+        memmove(mem, P2V(pa), PGSIZE);
+        pa = V2P(mem);
+      }
+      if(mappages(np->pgdir, (char*)va, PGSIZE, pa, PTE_FLAGS(*pte) & ~(PTE_D|PTE_A)) < 0){
+        if(v->flags == MAP_SHARED)
+          pcput(pg);
+        else
+          kfree(mem);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Map in the page of the current process's mapping containing va.
+// Returns -1 if va isn't mapped, or is written without PROT_WRITE.
+int
+mmapfault(uint va, int write)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+  struct inode *ip;
+  struct page *pg;
+  pte_t *pte;
+  uint pa;
+  char *mem;
+  int perm, r;
+
+  acquiresleep(&curproc->tg->vmlock);
+  r = -1;
+  if((v = findvma(curproc, va)) == 0)
+    goto out;
+  if(write && !(v->prot & PROT_WRITE))
+    goto out;
+  va = PGROUNDDOWN(va);
+  if((pte = walkpgdir(curproc->pgdir, (char*)va, 0)) != 0 && (*pte & PTE_P)){
+    r = write && !(*pte & PTE_W) ? -1 : 0;
+    goto out;
+  }
+
+  ip = v->f->ip;
+  ilock(ip);
+  pg = pcget(ip, v->off + (va - v->start));
+  iunlock(ip);
+  if(pg == 0)
+    goto out;
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(v->flags == MAP_SHARED)
+    pa = V2P(pg->data);
+  else {
+    if((mem = kalloc()) == 0){
+      pcput(pg);
+      goto out;
+    }
+    memmove(mem, pg->data, PGSIZE);
+    pcput(pg);
+    pa = V2P(mem);
+  }
+  if(mappages(curproc->pgdir, (char*)va, PGSIZE, pa, perm) < 0){
+    if(v->flags == MAP_SHARED)
+      pcput(pg);
+    else
+      kfree(P2V(pa));
+    goto out;
+  }
+  r = 0;
+
+out:
+  releasesleep(&curproc->tg->vmlock);
+  return r;
+}
+
+// Check that [addr, addr+n) lies in mappings of the current process,
+// writable ones if write is set, and map in all of its pages so the
+// kernel can use it without faulting.
+int
+mmapcheck(uint addr, uint n, int write)
+{
+  uint va;
+
+  if(n == 0)
+    return findvma(myproc(), addr) ? 0 : -1;
+  if(addr + n < addr)
+    return -1;
+  for(va = PGROUNDDOWN(addr); va < addr + n; va += PGSIZE)
+    if(mmapfault(va, write) < 0)
+      return -1;
+  return 0;
+}
@@ -0,0 +1,132 @@
+//
+// Per-namespace mount lists.
+//
+// Every mount namespace has its own list of mounts and its own lock, so
+// lookups only search the mounts of their own namespace and mount/umount
+// in one namespace doesn't contend with the others. unshare(MNT_NS) makes
+// the new namespace share the list of the old one; the list is copied the
+// first time either side removes a mount from it. Mounts are only ever
+// added at the head of a list, which leaves a shared tail untouched.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "namespace.h"
+#include "spinlock.h"
+#include "mnt_namespace.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "sysmount.h"
+
+void init_mnt_namespaces(void) {
+    //init lock for mnt_namespace_table
+    initlock(&mnt_ns_table.lock, "mnt_ns_table_lock");
+
+    for (int i = 0; i < NNAMESPACE; ++i) {
+        initlock(&mnt_ns_table.mnt_namespaces[i].lock, "mnt_ns_lock");
+        mnt_ns_table.mnt_namespaces[i].count = 0;
+    }
+}
+
+static mnt_namespace_struct* alloc_mnt_namespace(void) {
+    acquire(&mnt_ns_table.lock);
+    for (int i = 0; i < NNAMESPACE; ++i) {
+        mnt_namespace_struct* mnt_ns = &mnt_ns_table.mnt_namespaces[i];
+        if (mnt_ns->count == 0) {
+            mnt_ns->count = 1;
+            release(&mnt_ns_table.lock);
+            return mnt_ns;
+        }
+    }
+    release(&mnt_ns_table.lock);
+    panic("all mnt_namespaces are occupied");
+}
+
+// The initial namespace, whose only mount is the root set up by mountinit().
+mnt_namespace_struct* create_root_mnt_namespace(void) {
+    mnt_namespace_struct* mnt_ns = alloc_mnt_namespace();
+    mnt_ns->mntlist = gmnt.rootmnt; // takes over mountinit's reference
+    mnt_ns->rootmnt = gmnt.rootmnt;
+    mnt_ns->shared = false;
+    return mnt_ns;
+}
+
+// A new namespace sharing the mount list of mnt_ns.
+// Each list holds a reference to each of its mounts.
+mnt_namespace_struct* copy_mnt_namespace(mnt_namespace_struct* mnt_ns) {
+    mnt_namespace_struct* new_ns = alloc_mnt_namespace();
+
+    acquire(&mnt_ns->lock);
+    for (struct mntent* cur = mnt_ns->mntlist; cur != 0; cur = cur->next) {
+        mntdup(cur);
+    }
+    new_ns->mntlist = mnt_ns->mntlist;
+    new_ns->rootmnt = mnt_ns->rootmnt;
+    new_ns->shared = true;
+    mnt_ns->shared = true;
+    release(&mnt_ns->lock);
+
+    return new_ns;
+}
+
+mnt_namespace_struct* increase_mnt_namespace_count(mnt_namespace_struct* mnt_ns) {
+    acquire(&mnt_ns_table.lock);
+    mnt_ns->count++;
+    release(&mnt_ns_table.lock);
+    return mnt_ns;
+}
+
+static void put_mnt_list(struct mntent* list) {
+    struct mntent* next;
+    for (struct mntent* cur = list; cur != 0; cur = next) {
+        next = cur->next;
+        mntput(cur);
+    }
+}
+
+// Drop a reference to mnt_ns. The last one drops the namespace's
+// references to its mounts, which may unmount them.
+void put_mnt_namespace(mnt_namespace_struct* mnt_ns) {
+    acquire(&mnt_ns_table.lock);
+    if (mnt_ns->count < 1) {
+        panic("put_mnt_namespace: this mnt_namespace is never used");
+    }
+    if (--mnt_ns->count > 0) {
+        release(&mnt_ns_table.lock);
+        return;
+    }
+    struct mntent* list = mnt_ns->mntlist;
+    mnt_ns->mntlist = 0;
+    mnt_ns->rootmnt = 0;
+    mnt_ns->shared = false;
+    release(&mnt_ns_table.lock);
+
+    begin_op();
+    put_mnt_list(list);
+    end_op();
+}
+
+// Give mnt_ns a mount list of its own if it shares one with a clone.
+// Must be called inside a transaction since it calls mntput().
+void unshare_mnt_list(mnt_namespace_struct* mnt_ns) {
+    acquire(&mnt_ns->lock);
+    if (!mnt_ns->shared) {
+        release(&mnt_ns->lock);
+        return;
+    }
+    struct mntent* old = mnt_ns->mntlist;
+    mnt_ns->mntlist = mntcopylist(old, mnt_ns->rootmnt, &mnt_ns->rootmnt);
+    mnt_ns->shared = false;
+    release(&mnt_ns->lock);
+
+    put_mnt_list(old);
+}
+
+// The root mount of mnt_ns, with a reference held.
+struct mntent* get_mnt_namespace_root(mnt_namespace_struct* mnt_ns) {
+    acquire(&mnt_ns->lock);
+    struct mntent* rootmnt = mntdup(mnt_ns->rootmnt);
+    release(&mnt_ns->lock);
+    return rootmnt;
+}
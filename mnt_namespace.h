@@ -0,0 +1,21 @@
+//
+// Per-namespace mount lists.
+//
+
+#ifndef XV6_510_PROJECT_MNT_NAMESPACE_H
+#define XV6_510_PROJECT_MNT_NAMESPACE_H
+
+struct mnt_namespace {
+    int count;
+    struct spinlock lock;       // guards mntlist, rootmnt and shared
+    struct mntent *mntlist;     // mounts visible in this namespace
+    struct mntent *rootmnt;
+    bool shared;                // mntlist may still be in use by a clone
+};
+
+struct {
+    struct spinlock lock;
+    mnt_namespace_struct mnt_namespaces[NNAMESPACE];
+} mnt_ns_table;
+
+#endif //XV6_510_PROJECT_MNT_NAMESPACE_H
@@ -1,14 +1,27 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "mount.h"
  
 int main(int argc, char *argv[]) {
+  int type = MNT_LOOP;
+
+  if(argc > 1 && strcmp(argv[1], "-b") == 0){
+    type = MNT_BIND;
+    argv++;
+    argc--;
+  } else if(argc > 2 && strcmp(argv[1], "-t") == 0 && strcmp(argv[2], "tmpfs") == 0){
+    type = MNT_TMPFS;
+    argv += 2;
+    argc -= 2;
+  }
+
   if(argc < 3){
-    printf(2, "Usage: mount device mountpoint\n");
+    printf(2, "Usage: mount [-b | -t tmpfs] device mountpoint\n");
     exit(0);
   }
 
-  if (mount(argv[1], argv[2])) {
+  if (mount(argv[1], argv[2], type)) {
     printf(2, "Error: couldn't mount %s to %s\n", argv[2], argv[1]);
   }
   exit(0);
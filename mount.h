@@ -0,0 +1,4 @@
+// Mount types, the third argument of mount().
+#define MNT_LOOP  0   // device is a file holding a file system image
+#define MNT_BIND  1   // device is a directory grafted onto the mount point
+#define MNT_TMPFS 2   // empty in-memory file system; device is ignored
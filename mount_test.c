@@ -0,0 +1,224 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mount.h"
+
+#define MNT_NS 0b00000010
+
+int assert_non_negtive(int r, char *msg) {
+  if (r < 0) {
+      printf(2, "assert fails: ");
+      printf(2, msg);
+      printf(2, "\n");
+      exit(1);
+  }
+  return r;
+}
+
+int assert_true(int r, char *msg) {
+  if (r == 0) {
+      printf(2, "assert fails: ");
+      printf(2, msg);
+      printf(2, "\n");
+      exit(1);
+  }
+  return r;
+}
+
+int exists(char *path) {
+  struct stat st;
+  return stat(path, &st) == 0;
+}
+
+//Verify that relative lookups and ".." cross the mount point in both directions
+int test_relative_lookup_across_mount() {
+  printf(1, "------------test1------------\n");
+  mkdir("/mnt");
+  assert_non_negtive(mount("/l.img", "/mnt", MNT_LOOP), "failed to mount");
+
+  assert_non_negtive(chdir("/mnt"), "failed to chdir into mount");
+  assert_true(exists("README"), "README not found inside mount");
+  assert_true(!exists("l.img"), "root file visible inside mount");
+
+  assert_non_negtive(chdir(".."), "failed to chdir out of mount");
+  assert_true(exists("l.img"), "l.img not found after leaving mount");
+  assert_true(exists("mnt/README"), "README not found through mount point");
+  assert_true(exists("mnt/../l.img"), "\"..\" from mount root doesn't reach parent");
+
+  assert_non_negtive(umount("/mnt"), "failed to umount");
+  assert_true(!exists("/mnt/README"), "README still visible after umount");
+  printf(1, "test1 pass\n");
+  printf(1, "------------------------------\n");
+  return 0;
+}
+
+//Verify that a mount can't be unmounted while a process works inside it
+int test_umount_busy_with_cwd() {
+  printf(1, "------------test2------------\n");
+  mkdir("/mnt");
+  assert_non_negtive(mount("/l.img", "/mnt", MNT_LOOP), "failed to mount");
+
+  assert_non_negtive(chdir("/mnt"), "failed to chdir into mount");
+  assert_true(umount("/mnt") < 0, "umount succeeded with cwd inside mount");
+
+  assert_non_negtive(chdir("/"), "failed to chdir to root");
+  assert_non_negtive(umount("/mnt"), "failed to umount");
+  printf(1, "test2 pass\n");
+  printf(1, "------------------------------\n");
+  return 0;
+}
+
+//Verify that mounts and umounts after unshare(MNT_NS) stay in their namespace
+int test_mount_namespace() {
+  int fds[2];
+  char c;
+
+  printf(1, "------------test3------------\n");
+  mkdir("/mnt");
+  assert_non_negtive(pipe(fds), "failed to create pipe");
+
+  if (fork() == 0) {
+    assert_non_negtive(unshare(MNT_NS), "failed to unshare");
+    assert_non_negtive(mount("/l.img", "/mnt", MNT_LOOP), "failed to mount in new namespace");
+    assert_true(exists("/mnt/README"), "README not found in new namespace");
+    write(fds[1], "x", 1);
+    read(fds[0], &c, 1);
+    exit(0);
+  }
+  read(fds[0], &c, 1);
+  assert_true(!exists("/mnt/README"), "mount leaked out of new namespace");
+  write(fds[1], "x", 1);
+  wait();
+
+  assert_non_negtive(mount("/l.img", "/mnt", MNT_LOOP), "failed to mount");
+  if (fork() == 0) {
+    assert_non_negtive(unshare(MNT_NS), "failed to unshare");
+    assert_true(exists("/mnt/README"), "mount not inherited by new namespace");
+    assert_non_negtive(umount("/mnt"), "failed to umount in new namespace");
+    assert_true(!exists("/mnt/README"), "README still visible after umount");
+    exit(0);
+  }
+  wait();
+  assert_true(exists("/mnt/README"), "umount leaked out of new namespace");
+  assert_non_negtive(umount("/mnt"), "failed to umount");
+
+  close(fds[0]);
+  close(fds[1]);
+  printf(1, "test3 pass\n");
+  printf(1, "------------------------------\n");
+  return 0;
+}
+
+//Verify that a bind mount shows the source directory at the mount point
+int test_bind_mount() {
+  int fd;
+
+  printf(1, "------------test4------------\n");
+  mkdir("/bsrc");
+  mkdir("/bdst");
+  fd = assert_non_negtive(open("/bsrc/f", O_CREATE | O_RDWR), "failed to create file");
+  close(fd);
+
+  assert_non_negtive(mount("/bsrc", "/bdst", MNT_BIND), "failed to bind mount");
+  assert_true(exists("/bdst/f"), "source file not visible through bind mount");
+  fd = assert_non_negtive(open("/bdst/g", O_CREATE | O_RDWR), "failed to create file through bind mount");
+  close(fd);
+  assert_true(exists("/bsrc/g"), "file created through bind mount missing in source");
+  assert_true(exists("/bdst/../bsrc"), "\"..\" from bind mount doesn't reach parent");
+
+  assert_non_negtive(umount("/bdst"), "failed to umount");
+  assert_true(!exists("/bdst/f"), "source file still visible after umount");
+
+  unlink("/bsrc/f");
+  unlink("/bsrc/g");
+  unlink("/bsrc");
+  unlink("/bdst");
+  printf(1, "test4 pass\n");
+  printf(1, "------------------------------\n");
+  return 0;
+}
+
+//Verify that a tmpfs holds files in memory and loses them on umount
+int test_tmpfs() {
+  static char buf[512];
+  int fd, i;
+
+  printf(1, "------------test5------------\n");
+  mkdir("/tmp");
+  assert_non_negtive(mount("none", "/tmp", MNT_TMPFS), "failed to mount tmpfs");
+  assert_non_negtive(mkdir("/tmp/d"), "failed to mkdir in tmpfs");
+
+  // large enough to need the indirect page
+  fd = assert_non_negtive(open("/tmp/d/f", O_CREATE | O_RDWR), "failed to create file in tmpfs");
+  for (i = 0; i < 100; i++) {
+    memset(buf, i, sizeof(buf));
+    assert_true(write(fd, buf, sizeof(buf)) == sizeof(buf), "failed to write to tmpfs");
+  }
+  close(fd);
+
+  fd = assert_non_negtive(open("/tmp/d/f", O_RDONLY), "failed to open file in tmpfs");
+  for (i = 0; i < 100; i++) {
+    assert_true(read(fd, buf, sizeof(buf)) == sizeof(buf), "failed to read from tmpfs");
+    assert_true(buf[0] == (char) i && buf[sizeof(buf) - 1] == (char) i, "wrong data read from tmpfs");
+  }
+  assert_true(umount("/tmp") < 0, "umount succeeded with a file open");
+  close(fd);
+
+  assert_non_negtive(unlink("/tmp/d/f"), "failed to unlink in tmpfs");
+  assert_true(!exists("/tmp/d/f"), "file still exists after unlink");
+  fd = assert_non_negtive(open("/tmp/g", O_CREATE | O_RDWR), "failed to create file in tmpfs");
+  close(fd);
+
+  assert_non_negtive(umount("/tmp"), "failed to umount tmpfs");
+  assert_true(!exists("/tmp/g"), "tmpfs file survived umount");
+  printf(1, "test5 pass\n");
+  printf(1, "------------------------------\n");
+  return 0;
+}
+
+int main() {
+  int ret = -1;
+
+  //run test1
+  ret = fork();
+  if(ret == 0){
+    test_relative_lookup_across_mount();
+    exit(0);
+  }
+  wait();
+
+  //run test2
+  ret = fork();
+  if(ret == 0){
+    test_umount_busy_with_cwd();
+    exit(0);
+  }
+  wait();
+
+  //run test3
+  ret = fork();
+  if(ret == 0){
+    test_mount_namespace();
+    exit(0);
+  }
+  wait();
+
+  //run test4
+  ret = fork();
+  if(ret == 0){
+    test_bind_mount();
+    exit(0);
+  }
+  wait();
+
+  //run test5
+  ret = fork();
+  if(ret == 0){
+    test_tmpfs();
+    exit(0);
+  }
+  wait();
+
+  exit(0);
+}
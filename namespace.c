@@ -13,13 +13,16 @@ void ns_init() {
     initlock(&nstable.lock, "nstable");
     //init pid_namepsace
     init_pid_namespaces();
+    //init mnt_namespace
+    init_mnt_namespaces();
 }
 
 /*
  * The nsproxy count member is a reference counter, which is initialized to 1 when the nsproxy object is created by the
  * create_nsproxy() method, and which is decremented by the put_nsproxy() method and incremented by the get_nsproxy() method.
+ * create_nsproxy() takes a reference to each namespace passed in; NULL stands for the initial one.
  */
-nsproxy_struct* create_nsproxy(pid_namespace_struct * pid_namespace, bool is_lock_required) {
+nsproxy_struct* create_nsproxy(pid_namespace_struct * pid_namespace, mnt_namespace_struct * mnt_namespace, bool is_lock_required) {
     if(is_lock_required){
         acquire(&nstable.lock);
     }
@@ -35,6 +38,13 @@ nsproxy_struct* create_nsproxy(pid_namespace_struct * pid_namespace, bool is_loc
             }else{
                 nstable.nsproxy[i].pid_ns = increase_pid_namespace_count(pid_namespace);
             }
+
+            //init mnt_namespace
+            if(mnt_namespace == NULL){
+                nstable.nsproxy[i].mnt_ns = create_root_mnt_namespace();
+            }else{
+                nstable.nsproxy[i].mnt_ns = increase_mnt_namespace_count(mnt_namespace);
+            }
             
             if(is_lock_required){
                 release(&nstable.lock);
@@ -53,13 +63,22 @@ void free_nsproxy(nsproxy_struct* nsproxy) {
 }
 
 void put_nsproxy(nsproxy_struct* nsproxy) {
+    mnt_namespace_struct* mnt_ns = NULL;
+
     acquire(&nstable.lock);
     nsproxy->count--;
     if (nsproxy->count == 0) {
         remove_from_pid_namespace(nsproxy->pid_ns);
         nsproxy->pid_ns = NULL;
+        mnt_ns = nsproxy->mnt_ns;
+        nsproxy->mnt_ns = NULL;
     }
     release(&nstable.lock);
+
+    // dropping the last reference may unmount, which sleeps
+    if (mnt_ns) {
+        put_mnt_namespace(mnt_ns);
+    }
 }
 
 void get_nsproxy(nsproxy_struct* nsproxy) {
@@ -80,9 +99,18 @@ int unshare(int flags) {
     if (old_ns->count < 1) {
         panic("assert fails. namespace.c: 86\n"); // is there any situation that count <= 1 when unshare? (not sure)
     }
-    p->nsproxy = create_nsproxy(old_ns->pid_ns, false);  // should have a different ns now
+    mnt_namespace_struct* mnt_ns = old_ns->mnt_ns;
+    if ((flags & MNT_NS) > 0) {
+        //share the mount list copy-on-write
+        mnt_ns = copy_mnt_namespace(old_ns->mnt_ns);
+    }
+    p->nsproxy = create_nsproxy(old_ns->pid_ns, mnt_ns, false);  // should have a different ns now
     release(&nstable.lock);
 
+    if ((flags & MNT_NS) > 0) {
+        //the new nsproxy holds its own reference
+        put_mnt_namespace(mnt_ns);
+    }
     put_nsproxy(old_ns);
 
     if ((flags & PID_NS) > 0) {
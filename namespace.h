@@ -13,6 +13,7 @@ typedef struct nsproxy nsproxy_struct;
 struct nsproxy {
     int count;
     struct pid_namespace *pid_ns;
+    struct mnt_namespace *mnt_ns;
 };
 
 struct {
@@ -0,0 +1,13 @@
+// A page of file data in the page cache.
+struct page {
+  uint dev;
+  uint inum;
+  uint off;           // file offset, a multiple of PGSIZE
+  int valid;          // data has been read from the file?
+  int dirty;          // data is newer than the file's blocks?
+  int ref;            // users and mappings of the page
+  char *data;         // PGSIZE bytes, from kalloc()
+  struct page *prev;  // LRU cache list
+  struct page *next;
+  struct page *hnext; // hash chain, if inum is set
+};
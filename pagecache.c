@@ -0,0 +1,341 @@
+// Page cache.
+//
+// Holds file data in whole kalloc'd pages, separately from the
+// buffer cache, which is left to metadata: inodes, directories,
+// bitmaps and the log. Churn in those then doesn't evict hot file
+// data, and reads copy out of page-sized chunks. mmap() maps the
+// pages directly into processes; every process mapping the same
+// part of a file maps the same physical page. A page is named by
+// the device and inode number of its file and its offset in it.
+//
+// Interface:
+// * readi calls pcread for regular files of file systems that
+//     use the cache, which includes exec and the loop driver.
+// * pcget returns a page holding the file's data at an offset.
+// * pcput drops a reference. Unused pages stay cached until their
+//     slot is recycled, least recently used first.
+// * writei calls pcwrite for the same files, which only copies
+//     the data into pages and marks them dirty. For other files
+//     it calls pcupdate so cached pages follow writes.
+// * pcflush writes a file's dirty pages back, allocating the
+//     blocks they need only then; iflush is the usual caller,
+//     at the end of each write system call.
+// * pcinval forgets a file's pages when it is truncated or its
+//     device goes away.
+//
+// A page's data is filled in with the file's inode locked, which
+// also keeps two processes from filling the same page at once.
+// Dirty pages are never recycled, so at most half of the cache
+// may be dirty at a time.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "vfs.h"
+#include "page.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define NPAGEHASH 61
+
+struct {
+  struct spinlock lock;
+  struct page page[NPAGE];
+
+  // Linked list of all pages, through prev/next.
+  // head.next is most recently used.
+  struct page head;
+
+  // Pages that name a part of a file, by file and offset.
+  struct page *hash[NPAGEHASH];
+
+  int ndirty;
+} pcache;
+
+static struct page**
+bucket(uint dev, uint inum, uint off)
+{
+  return &pcache.hash[(dev * 31 + inum * 7 + off / PGSIZE) % NPAGEHASH];
+}
+
+// The page for (dev, inum, off), or 0. Caller holds pcache.lock.
+static struct page*
+lookup(uint dev, uint inum, uint off)
+{
+  struct page *pg;
+
+  for(pg = *bucket(dev, inum, off); pg; pg = pg->hnext)
+    if(pg->dev == dev && pg->inum == inum && pg->off == off)
+      return pg;
+  return 0;
+}
+
+// Take pg out of its hash chain. Caller holds pcache.lock.
+static void
+unhash(struct page *pg)
+{
+  struct page **pp;
+
+  if(pg->inum == 0)
+    return;
+  for(pp = bucket(pg->dev, pg->inum, pg->off); *pp != pg; pp = &(*pp)->hnext)
+    ;
+  *pp = pg->hnext;
+  pg->inum = 0;
+  pg->valid = 0;
+  if(pg->dirty){
+    pg->dirty = 0;
+    pcache.ndirty--;
+  }
+}
+
+void
+pcinit(void)
+{
+  struct page *pg;
+
+  initlock(&pcache.lock, "pcache");
+
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  for(pg = pcache.page; pg < pcache.page+NPAGE; pg++){
+    pg->next = pcache.head.next;
+    pg->prev = &pcache.head;
+    pcache.head.next->prev = pg;
+    pcache.head.next = pg;
+  }
+}
+
+// Return the page of ip at offset off, referenced, or 0 if
+// there is no memory for it. off must be a multiple of PGSIZE.
+// Caller must hold ip->lock.
+struct page*
+pcget(struct inode *ip, uint off)
+{
+  struct page *pg;
+  int n;
+
+  acquire(&pcache.lock);
+  if((pg = lookup(ip->dev, ip->inum, off)) != 0){
+    pg->ref++;
+    release(&pcache.lock);
+    goto found;
+  }
+  for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev){
+    if(pg->ref == 0 && !pg->dirty){
+      unhash(pg);
+      pg->dev = ip->dev;
+      pg->inum = ip->inum;
+      pg->off = off;
+      pg->valid = 0;
+      pg->ref = 1;
+      pg->hnext = *bucket(pg->dev, pg->inum, pg->off);
+      *bucket(pg->dev, pg->inum, pg->off) = pg;
+      release(&pcache.lock);
+      goto found;
+    }
+  }
+  release(&pcache.lock);
+  return 0;
+
+found:
+  if(!pg->valid){
+    if(pg->data == 0 && (pg->data = kalloc()) == 0){
+      pcput(pg);
+      return 0;
+    }
+    // the page's part of the file; the rest reads as zeros
+    if((n = ip->sp->ops->readi(ip, pg->data, off, PGSIZE)) < 0)
+      n = 0;
+    memset(pg->data + n, 0, PGSIZE - n);
+    pg->valid = 1;
+  }
+  return pg;
+}
+
+// Read n bytes of ip at off through the cache, like readi.
+// If every page is in use, reads straight from the file system.
+// Caller must hold ip->lock.
+int
+pcread(struct inode *ip, char *dst, uint off, uint n)
+{
+  struct page *pg;
+  uint tot, m, pgoff;
+
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    pgoff = PGROUNDDOWN(off);
+    m = min(n - tot, PGSIZE - (off - pgoff));
+    if((pg = pcget(ip, pgoff)) == 0){
+      if(ip->sp->ops->readi(ip, dst, off, m) != m)
+        return -1;
+      continue;
+    }
+    memmove(dst, pg->data + (off - pgoff), m);
+    pcput(pg);
+  }
+  return n;
+}
+
+// Drop a reference to pg.
+// Move to the head of the MRU list once unused.
+void
+pcput(struct page *pg)
+{
+  acquire(&pcache.lock);
+  if(pg->ref < 1)
+    panic("pcput");
+  pg->ref--;
+  if(pg->ref == 0){
+    pg->next->prev = pg->prev;
+    pg->prev->next = pg->next;
+    pg->next = pcache.head.next;
+    pg->prev = &pcache.head;
+    pcache.head.next->prev = pg;
+    pcache.head.next = pg;
+  }
+  release(&pcache.lock);
+}
+
+// Copy n bytes written to ip at off into the cached pages
+// that hold them. Caller must hold ip->lock.
+void
+pcupdate(struct inode *ip, char *src, uint off, uint n)
+{
+  struct page *pg;
+  uint pgoff, m;
+
+  for(; n > 0; n -= m, off += m, src += m){
+    pgoff = PGROUNDDOWN(off);
+    m = min(n, PGSIZE - (off - pgoff));
+    acquire(&pcache.lock);
+    if((pg = lookup(ip->dev, ip->inum, pgoff)) == 0 || !pg->valid){
+      release(&pcache.lock);
+      continue;
+    }
+    pg->ref++;
+    release(&pcache.lock);
+    memmove(pg->data + (off - pgoff), src, m);
+    pcput(pg);
+  }
+}
+
+// Copy n bytes at src into the cached pages of ip at off,
+// extending the file in memory if they go past its end, and
+// mark the pages dirty for pcflush to write back. Stops short
+// when a page can't be had or half of the cache is dirty.
+// Returns the number of bytes copied, or -1.
+// Caller must hold ip->lock.
+int
+pcwrite(struct inode *ip, char *src, uint off, uint n)
+{
+  struct page *pg;
+  uint tot, m, pgoff;
+
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > MAXFILE*BSIZE)
+    return -1;
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    pgoff = PGROUNDDOWN(off);
+    m = min(n - tot, PGSIZE - (off - pgoff));
+    acquire(&pcache.lock);
+    pg = lookup(ip->dev, ip->inum, pgoff);
+    if((pg == 0 || !pg->dirty) && pcache.ndirty >= NPAGE/2){
+      release(&pcache.lock);
+      break;
+    }
+    release(&pcache.lock);
+    if((pg = pcget(ip, pgoff)) == 0)
+      break;
+    memmove(pg->data + (off - pgoff), src, m);
+    pcdirty(pg);
+    pcput(pg);
+    if(off + m > ip->size)
+      ip->size = off + m;
+  }
+  return tot;
+}
+
+// Mark pg, which holds data inside its file, as newer than
+// the file's blocks.
+void
+pcdirty(struct page *pg)
+{
+  acquire(&pcache.lock);
+  if(!pg->dirty){
+    pg->dirty = 1;
+    pcache.ndirty++;
+  }
+  release(&pcache.lock);
+}
+
+// Write the dirty pages of ip back to its file system, in file
+// order. If alloc is set, blocks the pages don't have yet are
+// allocated, as many as the caller's transaction has log space
+// for, and the inode is updated once all of them are written.
+// Returns the number of pages still dirty.
+// Caller must hold ip->lock, and be inside a transaction if alloc.
+int
+pcflush(struct inode *ip, int alloc)
+{
+  struct wbroom room;
+  struct page *pg;
+  uint off;
+  int left;
+
+  room.left = MAXOPBLOCKS - 1;  // the inode's block
+  room.lastbmap = 0;
+  room.indirect = 0;
+  left = 0;
+  for(off = 0; off < ip->size; off += PGSIZE){
+    acquire(&pcache.lock);
+    if((pg = lookup(ip->dev, ip->inum, off)) == 0 || !pg->dirty){
+      release(&pcache.lock);
+      continue;
+    }
+    pg->dirty = 0;
+    pcache.ndirty--;
+    pg->ref++;
+    release(&pcache.lock);
+    if(ip->sp->ops->writepage(ip, pg->data, off, min(PGSIZE, ip->size - off),
+                              alloc ? &room : 0) < 0){
+      pcdirty(pg);
+      left++;
+    }
+    pcput(pg);
+  }
+  if(alloc && (room.left < MAXOPBLOCKS - 1 || (left == 0 && ip->dsize != ip->size))){
+    if(left == 0)
+      ip->dsize = ip->size;
+    iupdate(ip);
+    ip->dataseq = ip->seq;
+  }
+  return left;
+}
+
+// Forget the idle cached pages of inode inum on device dev,
+// or of every inode on dev if inum is 0.
+void
+pcinval(uint dev, uint inum)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.head.next; pg != &pcache.head; pg = pg->next){
+    if(pg->inum != 0 && pg->dev == dev && (inum == 0 || pg->inum == inum) &&
+       pg->ref == 0)
+      unhash(pg);
+  }
+  release(&pcache.lock);
+}
@@ -9,7 +9,11 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NBUF         (LOGSIZE*3)  // size of disk block cache; both logs pin blocks
+#define COMMITTICKS  500  // longest a log transaction stays open, in ticks
+#define NPAGE       256  // size of file page cache
+#define NVMA          8  // memory mappings per process
+#define PIPEPAGES   256  // pages all pipe buffers may grow by, in all
 #define FSSIZE       1000  // size of file system in blocks
 
 #define NNAMESPACE 10
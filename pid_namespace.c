@@ -12,6 +12,7 @@
 #include "pid_namespace.h"
 #include "mmu.h"
 #include "proc.h"
+#include "sched.h"
 
 
 void set_pid_namespace(pid_namespace_struct* pid_namespace, int count, pid_namespace_struct* parent_namespace, int next_pid, int depth, bool is_pid_1_killed){
@@ -25,6 +26,12 @@ void set_pid_namespace(pid_namespace_struct* pid_namespace, int count, pid_names
     pid_namespace->depth = depth;
     //set is pid 1 killed or not 
     pid_namespace->is_pid_1_killed = is_pid_1_killed;
+    //start with the default CPU share and no CPU time
+    pid_namespace->weight = SHARE_DEFAULT;
+    pid_namespace->vruntime = 0;
+    pid_namespace->minvruntime = 0;
+    //start with no processes
+    memset(pid_namespace->pidhash, 0, sizeof(pid_namespace->pidhash));
 }
 
 void init_pid_namespaces(void) {
@@ -7,6 +7,8 @@
 
 
 
+#define NPIDHASH 32
+
 struct pid_namespace {
     int count;
     struct pid_namespace* parent;
@@ -14,6 +16,10 @@ struct pid_namespace {
     int next_pid;
     int depth;
     bool is_pid_1_killed;
+    int weight;          // CPU share of all its processes together
+    uint vruntime;       // CPU time of its processes, scaled by 1/weight
+    uint minvruntime;    // floor for the vruntime of its processes joining a run queue
+    struct pid_entry* pidhash[NPIDHASH]; // its processes by pid, guarded by ptable.lock
 };
 
 struct {
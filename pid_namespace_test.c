@@ -5,6 +5,7 @@
 #include "types.h"
 #include "user.h"
 #include "test_utility.h"
+#include "sched.h"
 
 #define PID_NS 0b00000001
 
@@ -210,6 +211,42 @@ int test_all_proc_killed_after_pid1_killed(){
   }
 }
 
+//Verify that setsched checks its values and that only an ancestor sets a namespace's weight
+int test_setsched(){
+  printf(1, "------------test4------------\n");
+  int tochild[2], toparent[2];
+  char c;
+
+  assert_true(setsched(0, SCHED_FAIR, NICE_MAX + 1) < 0, "nice level out of range accepted");
+  assert_true(setsched(0, SCHED_PRIO, PRIO_MAX + 1) < 0, "priority out of range accepted");
+  assert_true(setsched(0, SCHED_SHARE, 0) < 0, "zero weight accepted");
+  assert_non_negtive(setsched(0, SCHED_FAIR, 5), "failed to set nice level");
+  assert_non_negtive(setsched(0, SCHED_PRIO, 1), "failed to set priority");
+  assert_non_negtive(setsched(0, SCHED_FAIR, 0), "failed to go back to fair share");
+
+  assert_non_negtive(pipe(tochild), "failed to create pipe\n");
+  assert_non_negtive(pipe(toparent), "failed to create pipe\n");
+  assert_non_negtive(unshare(PID_NS), "failed to unshare\n");
+  int ret = assert_non_negtive(fork(), "failed to fork\n");
+  if (ret == 0) {// child, pid 1 in the new namespace
+    assert_true(setsched(0, SCHED_SHARE, SHARE_MAX) < 0, "namespace set its own weight");
+    assert_true(setsched(0, SCHED_PRIO, 1) < 0, "namespace set a fixed priority");
+    assert_non_negtive(setsched(0, SCHED_FAIR, NICE_MIN), "failed to set nice level in namespace");
+    write(toparent[1], "x", 1);
+    read(tochild[0], &c, 1);
+    exit(0);
+  }else{// parent
+    read(toparent[0], &c, 1);
+    assert_non_negtive(setsched(ret, SCHED_SHARE, 2 * SHARE_DEFAULT), "failed to set child namespace weight");
+    assert_non_negtive(setsched(ret, SCHED_PRIO, 1), "failed to set priority in child namespace");
+    write(tochild[1], "x", 1);
+    wait();
+    printf(1, "test4 pass\n");
+    printf(1, "------------------------------\n");
+    return 0;
+  }
+}
+
 int main() {
   int ret = -1;
 
@@ -237,5 +274,13 @@ int main() {
   }
   wait();
 
+  //run test4
+  ret = fork();
+  if(ret == 0){
+    test_setsched();
+    exit(0);
+  }
+  wait();
+
   exit(0);
 }
\ No newline at end of file
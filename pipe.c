@@ -8,17 +8,92 @@
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+#include "fcntl.h"
+
+// The data lives in a ring of pages, one to begin with.
+// fcntl(F_SETPIPE_SZ) can grow it up to PIPEMAXPAGES, as long
+// as all pipes together have no more than PIPEPAGES past their
+// first pages, so that no one can fill memory with pipes.
+// Readers and writers copy a page-sized run at a time, and
+// only wake each other when the ring is half full (or the
+// write is done) or half empty, and only if someone sleeps.
+#define PIPEMAXPAGES (PIPEMAXSIZE / PGSIZE)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *pages[PIPEMAXPAGES];
+  uint size;      // bytes in the ring; pages times PGSIZE, a power of 2
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rbusy;      // a splice is reading from the ring in place
+  int wbusy;      // a splice is writing into the ring in place
+  int rwait;      // a reader may be sleeping on nread
+  int wwait;      // a writer may be sleeping on nwrite
 };
 
+// Address of byte off of the stream in the ring. *contig is
+// set to how many bytes from there on are in the same page.
+static char*
+ringaddr(struct pipe *p, uint off, uint *contig)
+{
+  off %= p->size;
+  *contig = PGSIZE - off % PGSIZE;
+  return p->pages[off / PGSIZE] + off % PGSIZE;
+}
+
+static void
+wakereader(struct pipe *p)
+{
+  if(p->rwait){
+    p->rwait = 0;
+    wakeup(&p->nread);
+  }
+}
+
+static void
+wakewriter(struct pipe *p)
+{
+  if(p->wwait){
+    p->wwait = 0;
+    wakeup(&p->nwrite);
+  }
+}
+
+// Wake a writer waiting for room once half the ring is free.
+static void
+drained(struct pipe *p)
+{
+  if(p->nread + p->size - p->nwrite >= p->size / 2)
+    wakewriter(p);
+}
+
+// Pages of pipe rings past the first page of each.
+static int extrapages;
+
+// Account for n more pages of pipe rings, or fewer if n is
+// negative. Fails if that would go over PIPEPAGES.
+static int
+chargepages(int n)
+{
+  if(__sync_add_and_fetch(&extrapages, n) > PIPEPAGES && n > 0){
+    __sync_sub_and_fetch(&extrapages, n);
+    return -1;
+  }
+  return 0;
+}
+
+static void
+freepages(char **pages, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    kfree(pages[i]);
+}
+
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,10 +105,17 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  if((p->pages[0] = kalloc()) == 0)
+    goto bad;
+  p->size = PGSIZE;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
+  p->rbusy = 0;
+  p->wbusy = 0;
+  p->rwait = 0;
+  p->wwait = 0;
   initlock(&p->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -69,30 +151,109 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
+    chargepages(1 - p->size / PGSIZE);
+    freepages(p->pages, p->size / PGSIZE);
     kfree((char*)p);
   } else
     release(&p->lock);
 }
 
+// Resize the ring of p to hold at least n bytes, rounded up to a
+// power-of-two number of pages. Fails if the data in the pipe
+// would not fit, a splice holds part of the ring, or pipes would
+// have more than PIPEPAGES extra pages.
+// Returns the new size.
+int
+pipesetsize(struct pipe *p, int n)
+{
+  char *pages[PIPEMAXPAGES], *old[PIPEMAXPAGES];
+  char *src;
+  int npages, oldpages, i;
+  uint off, m, contig;
+
+  if(n <= 0 || n > PIPEMAXSIZE)
+    return -1;
+  for(npages = 1; npages * PGSIZE < n; npages *= 2)
+    ;
+  for(i = 0; i < npages; i++){
+    if((pages[i] = kalloc()) == 0){
+      freepages(pages, i);
+      return -1;
+    }
+  }
+
+  acquire(&p->lock);
+  oldpages = p->size / PGSIZE;
+  if(p->rbusy || p->wbusy || p->nwrite - p->nread > npages * PGSIZE ||
+     chargepages(npages - oldpages) < 0){
+    release(&p->lock);
+    freepages(pages, npages);
+    return -1;
+  }
+  // move the unread data to the start of the new ring
+  for(off = 0; p->nread + off != p->nwrite; off += m){
+    src = ringaddr(p, p->nread + off, &contig);
+    m = p->nwrite - p->nread - off;
+    if(m > contig)
+      m = contig;
+    if(m > PGSIZE - off % PGSIZE)
+      m = PGSIZE - off % PGSIZE;
+    memmove(pages[off / PGSIZE] + off % PGSIZE, src, m);
+  }
+  memmove(old, p->pages, oldpages * sizeof(char*));
+  memmove(p->pages, pages, npages * sizeof(char*));
+  p->size = npages * PGSIZE;
+  p->nread = 0;
+  p->nwrite = off;
+  drained(p);
+  release(&p->lock);
+
+  freepages(old, oldpages);
+  return npages * PGSIZE;
+}
+
+int
+pipegetsize(struct pipe *p)
+{
+  int n;
+
+  acquire(&p->lock);
+  n = p->size;
+  release(&p->lock);
+  return n;
+}
+
 //PAGEBREAK: 40
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
   int i;
+  uint m, contig;
+  char *dst;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
+  for(i = 0; i < n; i += m){
+    while(p->wbusy || p->nwrite == p->nread + p->size){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      wakereader(p);
+      p->wwait = 1;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    dst = ringaddr(p, p->nwrite, &contig);
+    m = n - i;
+    if(m > contig)
+      m = contig;
+    if(m > p->nread + p->size - p->nwrite)
+      m = p->nread + p->size - p->nwrite;
+    memmove(dst, addr + i, m);
+    p->nwrite += m;
+    if(p->nwrite - p->nread >= p->size / 2)
+      wakereader(p);
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  wakereader(p);  //DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
@@ -101,21 +262,123 @@ int
 piperead(struct pipe *p, char *addr, int n)
 {
   int i;
+  uint m, contig;
+  char *src;
 
   acquire(&p->lock);
-  while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
+  while(p->rbusy || (p->nread == p->nwrite && p->writeopen)){  //DOC: pipe-empty
     if(myproc()->killed){
       release(&p->lock);
       return -1;
     }
+    p->rwait = 1;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  for(i = 0; i < n && p->nread != p->nwrite; i += m){  //DOC: piperead-copy
+    src = ringaddr(p, p->nread, &contig);
+    m = n - i;
+    if(m > contig)
+      m = contig;
+    if(m > p->nwrite - p->nread)
+      m = p->nwrite - p->nread;
+    memmove(addr + i, src, m);
+    p->nread += m;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  drained(p);  //DOC: piperead-wakeup
   release(&p->lock);
   return i;
 }
+
+//PAGEBREAK: 40
+// splice() moves data between a pipe and a file without a user
+// buffer. The splicer reserves a contiguous run of the ring, reads
+// the file into it or writes it to the file with the pipe lock
+// released (readi and writei may sleep), and then commits.
+// The reservation keeps other readers or writers out meanwhile.
+
+// Reserve up to n bytes of free space at *addr, waiting for
+// some to appear. Returns the number reserved, or -1 if the
+// read side has been closed. Finish with pipewriteend().
+int
+pipewritebegin(struct pipe *p, char **addr, int n)
+{
+  uint m, contig;
+
+  acquire(&p->lock);
+  while(p->wbusy || p->nwrite == p->nread + p->size){
+    if(p->readopen == 0 || myproc()->killed){
+      release(&p->lock);
+      return -1;
+    }
+    wakereader(p);
+    p->wwait = 1;
+    sleep(&p->nwrite, &p->lock);
+  }
+  *addr = ringaddr(p, p->nwrite, &contig);
+  m = p->nread + p->size - p->nwrite;
+  if(m > contig)
+    m = contig;
+  if(m > n)
+    m = n;
+  p->wbusy = 1;
+  release(&p->lock);
+  return m;
+}
+
+// Publish the first n bytes of the space reserved by
+// pipewritebegin() and drop the reservation. Readers are
+// woken when the ring is half full, or if done is set.
+void
+pipewriteend(struct pipe *p, int n, int done)
+{
+  acquire(&p->lock);
+  p->nwrite += n;
+  p->wbusy = 0;
+  if(done || p->nwrite - p->nread >= p->size / 2)
+    wakereader(p);
+  wakewriter(p);
+  release(&p->lock);
+}
+
+// Reserve up to n bytes of data at *addr. If the pipe is empty,
+// wait for data only if wait is set. Returns the number reserved,
+// 0 at end of file or if empty, or -1 if killed. If it returns
+// more than 0, finish with pipereadend().
+int
+pipereadbegin(struct pipe *p, char **addr, int n, int wait)
+{
+  uint m, contig;
+
+  acquire(&p->lock);
+  while(p->rbusy || (p->nread == p->nwrite && p->writeopen && wait)){
+    if(myproc()->killed){
+      release(&p->lock);
+      return -1;
+    }
+    p->rwait = 1;
+    sleep(&p->nread, &p->lock);
+  }
+  *addr = ringaddr(p, p->nread, &contig);
+  m = p->nwrite - p->nread;
+  if(m > contig)
+    m = contig;
+  if(m > n)
+    m = n;
+  if(m > 0)
+    p->rbusy = 1;
+  release(&p->lock);
+  return m;
+}
+
+// Consume the first n bytes of the data reserved by
+// pipereadbegin() and drop the reservation.
+void
+pipereadend(struct pipe *p, int n)
+{
+  acquire(&p->lock);
+  p->nread += n;
+  p->rbusy = 0;
+  wakereader(p);
+  drained(p);
+  release(&p->lock);
+}
@@ -8,35 +8,213 @@
 #include "namespace.h"
 #include "pid_namespace.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "tgroup.h"
 #include "sysmount.h"
-
+#include "sched.h"
+#include "traps.h"
+#include "futex.h"
+#include "wait.h"
+
+// ptable.lock guards allocation, the parent links, exit and
+// wait. It is acquired before any wait or run queue lock, which
+// are acquired before any pid namespace lock.
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
 } ptable;
 
+// Per-CPU run queues of RUNNABLE processes.
+//
+// A process joins the queue of the CPU it last ran on, which
+// likely still caches its working set. If its affinity mask
+// no longer allows that CPU, the CPU's scheduler passes it on
+// to one it allows when it comes off the queue. Each CPU's
+// scheduler runs its own queue, taking a process from the
+// longest other queue only when its own is empty or the other
+// is at least two longer, so processes stay put unless the load
+// is uneven.
+//
+// SCHED_PRIO processes run before any SCHED_FAIR one, highest
+// priority first and round-robin within a priority. SCHED_FAIR
+// processes are picked first by pid namespace and then within
+// it, the one that has had the least CPU time for its weight
+// each time: a namespace's processes together get a share of
+// the CPU that goes with the namespace's weight, and each gets a
+// share of that which goes with its nice level. Time is charged
+// by the clock tick. A process takes its place in the order as
+// it joins a queue, so picking the next one is quick.
+//
+// The lock of a CPU's queue is held across every context switch
+// on that CPU: a process calls sched() holding it and the
+// process switched to releases it. Since a process only ever
+// joins its own CPU's queue, a process that is still switching
+// away can't be woken, stolen or freed before it is done.
+//
+// A CPU with nothing to run or steal halts, with its clock tick
+// stopped, until an IPI says there is work. CPU 0 keeps its
+// tick, which keeps ticks.
+#define NPRIO (PRIO_MAX+1)
+
+struct runq {
+  struct spinlock lock;
+  struct proc *prio[NPRIO];      // SCHED_PRIO processes by priority, next to run first
+  struct proc *priotail[NPRIO];
+  struct proc *fair;             // SCHED_FAIR processes, next to run first
+  uint minvruntime;              // floor for the vruntime of namespaces joining
+  int n;
+};
+
+static struct runq runqs[NCPU];
+
+// Wait queues of sleeping processes, hashed by channel.
+//
+// The lock of a channel's queue plays the part for sleep and
+// wakeup that ptable.lock used to: it guards the queue and the
+// SLEEPING state of the processes on it, so a wakeup only
+// looks at the processes sleeping on channels that hash the
+// same. It is acquired before any run queue lock.
+#define NWAITQ 61
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+};
+
+static struct waitq waitqs[NWAITQ];
+
+static struct waitq*
+waitq(void *chan)
+{
+  return &waitqs[(uint)chan / sizeof(uint) % NWAITQ];
+}
+
+// Thread groups, allocated and freed under ptable.lock.
+static struct tgroup tgroups[NPROC];
+
+// Futex waits and wakes hold this around the check of the
+// futex word and the sleep or wakeup.
+static struct spinlock futexlock;
+
 static struct proc *initproc;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
+static void wakeproc(struct proc *p);
 
 int get_namespace_pid(struct proc* proc, pid_namespace_struct* pid_namespace) {
-  int i = 0;
-  while(i < PID_NAMESPACE_MAX_DEPTH){
-    pid_namespace_struct* ns = proc->pids[i].pid_ns;
-    if(ns == pid_namespace){
-      //return pid
-      return proc->pids[i].pid;
-    }
-    ++i;
+  // pids[0] is in the innermost namespace, and each next
+  // one in the parent of the one before
+  if(proc->pids[0].pid_ns == 0)
+    return 0;
+  int i = proc->pids[0].pid_ns->depth - pid_namespace->depth;
+  if(i >= 0 && i < PID_NAMESPACE_MAX_DEPTH && proc->pids[i].pid_ns == pid_namespace){
+    //return pid
+    return proc->pids[i].pid;
   }
   //return 0 as parent proc fork result
   return 0;
 }
 
+// Enter p in the pid hash of each namespace it has a pid in.
+// Each entry holds a count on its namespace until p is reaped,
+// so a namespace slot isn't reused while its zombies are hashed.
+// Caller holds ptable.lock.
+static void
+hashpids(struct proc *p)
+{
+  struct pid_entry *e, **bucket;
+
+  for(e = p->pids; e < &p->pids[PID_NAMESPACE_MAX_DEPTH] && e->pid_ns; e++){
+    increase_pid_namespace_count(e->pid_ns);
+    bucket = &e->pid_ns->pidhash[e->pid % NPIDHASH];
+    e->proc = p;
+    e->hnext = *bucket;
+    *bucket = e;
+  }
+}
+
+static void
+unhashpids(struct proc *p)
+{
+  struct pid_entry *e, **ep;
+
+  for(e = p->pids; e < &p->pids[PID_NAMESPACE_MAX_DEPTH] && e->pid_ns; e++){
+    for(ep = &e->pid_ns->pidhash[e->pid % NPIDHASH]; *ep != e; ep = &(*ep)->hnext)
+      ;
+    *ep = e->hnext;
+    remove_from_pid_namespace(e->pid_ns);
+  }
+}
+
+// The process with the given pid in pid namespace ns, or 0.
+// Caller holds ptable.lock.
+static struct proc*
+findpid(pid_namespace_struct *ns, int pid)
+{
+  struct pid_entry *e;
+
+  if(pid <= 0)
+    return 0;
+  for(e = ns->pidhash[pid % NPIDHASH]; e; e = e->hnext)
+    if(e->pid == pid)
+      return e->proc;
+  return 0;
+}
+
+// Put zombie p on its parent's list of exited children.
+// Caller holds ptable.lock.
+static void
+addzombie(struct proc *p)
+{
+  p->zprev = 0;
+  p->znext = p->parent->zombies;
+  if(p->znext)
+    p->znext->zprev = p;
+  p->parent->zombies = p;
+}
+
+static void
+delzombie(struct proc *p)
+{
+  if(p->zprev)
+    p->zprev->znext = p->znext;
+  else
+    p->parent->zombies = p->znext;
+  if(p->znext)
+    p->znext->zprev = p->zprev;
+}
+
+// Move p to parent's list of children, or to none if parent
+// is 0. Caller holds ptable.lock.
+static void
+setparent(struct proc *p, struct proc *parent)
+{
+  if(p->parent){
+    if(p->state == ZOMBIE)
+      delzombie(p);
+    if(p->sibprev)
+      p->sibprev->sibnext = p->sibnext;
+    else
+      p->parent->child = p->sibnext;
+    if(p->sibnext)
+      p->sibnext->sibprev = p->sibprev;
+  }
+  p->parent = parent;
+  p->sibprev = 0;
+  p->sibnext = 0;
+  if(parent){
+    p->sibnext = parent->child;
+    if(parent->child)
+      parent->child->sibprev = p;
+    parent->child = p;
+    if(p->state == ZOMBIE)
+      addzombie(p);
+  }
+}
+
 int proc_pid(struct proc* proc) {
     return get_namespace_pid(proc, myproc()->nsproxy->pid_ns);
 }
@@ -44,7 +222,386 @@ int proc_pid(struct proc* proc) {
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(i = 0; i < NCPU; i++)
+    initlock(&runqs[i].lock, "runq");
+  for(i = 0; i < NWAITQ; i++)
+    initlock(&waitqs[i].lock, "waitq");
+  for(i = 0; i < NPROC; i++){
+    initsleeplock(&tgroups[i].vmlock, "vm");
+    initlock(&tgroups[i].lock, "tgroup");
+  }
+  initlock(&futexlock, "futex");
+}
+
+// A new, empty thread group of one thread, or 0.
+static struct tgroup*
+tgalloc(void)
+{
+  struct tgroup *tg;
+
+  acquire(&ptable.lock);
+  for(tg = tgroups; tg < &tgroups[NPROC]; tg++){
+    if(tg->ref == 0){
+      tg->ref = 1;
+      release(&ptable.lock);
+      tg->sz = 0;
+      memset(tg->vmas, 0, sizeof(tg->vmas));
+      memset(tg->ofile, 0, sizeof(tg->ofile));
+      tg->cwd = 0;
+      tg->cwdmnt = 0;
+      return tg;
+    }
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
+// Free tg, which no thread uses any more.
+static void
+tgfree(struct tgroup *tg)
+{
+  acquire(&ptable.lock);
+  tg->ref = 0;
+  release(&ptable.lock);
+}
+
+// Weights of the nice levels NICE_MIN..NICE_MAX. Each level
+// gets about 10% more CPU than the next one down.
+static const int niceweight[NICE_MAX-NICE_MIN+1] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+
+// What a tick of CPU time adds to vruntime at weight 1.
+#define VTICK (1024*1024)
+
+// The pid namespace p is in. Unlike p->nsproxy, which exit()
+// drops, this stays set until p is freed.
+static pid_namespace_struct*
+procns(struct proc *p)
+{
+  return p->pids[0].pid_ns;
+}
+
+// Whether virtual time a is before b. They wrap around.
+static int
+vbefore(uint a, uint b)
+{
+  return (int)(a - b) < 0;
+}
+
+// Whether SCHED_FAIR process p should run before q: the one in
+// the namespace that has had less CPU time, or else the one that
+// has itself had less.
+static int
+runsbefore(struct proc *p, struct proc *q)
+{
+  pid_namespace_struct *ns = procns(p), *qns = procns(q);
+
+  if(ns != qns)
+    return vbefore(ns->vruntime, qns->vruntime);
+  return vbefore(p->vruntime, q->vruntime);
+}
+
+static void
+enqueue(struct runq *rq, struct proc *p)
+{
+  struct proc **pp;
+
+  p->rqnext = 0;
+  if(p->policy == SCHED_PRIO){
+    if(rq->priotail[p->prio])
+      rq->priotail[p->prio]->rqnext = p;
+    else
+      rq->prio[p->prio] = p;
+    rq->priotail[p->prio] = p;
+  } else {
+    // After those it ties with, so equals take turns.
+    for(pp = &rq->fair; *pp && !runsbefore(p, *pp); pp = &(*pp)->rqnext)
+      ;
+    p->rqnext = *pp;
+    *pp = p;
+  }
+  rq->n++;
+}
+
+static struct proc*
+dequeue(struct runq *rq)
+{
+  struct proc *p;
+  pid_namespace_struct *ns;
+  int i;
+
+  for(i = PRIO_MAX; i >= 0; i--){
+    if((p = rq->prio[i]) != 0){
+      if((rq->prio[i] = p->rqnext) == 0)
+        rq->priotail[i] = 0;
+      rq->n--;
+      p->rqnext = 0;
+      return p;
+    }
+  }
+
+  if((p = rq->fair) == 0)
+    return 0;
+  rq->fair = p->rqnext;
+  rq->n--;
+  p->rqnext = 0;
+
+  // Processes and namespaces that join later start no further
+  // behind than the ones running now, so they can't make up
+  // for the time they spent asleep by hogging the CPU.
+  ns = procns(p);
+  if(vbefore(rq->minvruntime, ns->vruntime))
+    rq->minvruntime = ns->vruntime;
+  acquire(&ns->lock);
+  if(vbefore(ns->minvruntime, p->vruntime))
+    ns->minvruntime = p->vruntime;
+  release(&ns->lock);
+  return p;
+}
+
+// Bring the vruntime of p and of its namespace up to the floors
+// as p joins rq after sleeping or being created.
+static void
+place(struct runq *rq, struct proc *p)
+{
+  pid_namespace_struct *ns = procns(p);
+
+  if(p->policy != SCHED_FAIR)
+    return;
+  acquire(&ns->lock);
+  if(vbefore(p->vruntime, ns->minvruntime))
+    p->vruntime = ns->minvruntime;
+  if(vbefore(ns->vruntime, rq->minvruntime))
+    ns->vruntime = rq->minvruntime;
+  release(&ns->lock);
+}
+
+// Charge p and its namespace for the clock tick p ran.
+static void
+charge(struct proc *p)
+{
+  pid_namespace_struct *ns = procns(p);
+
+  if(p->policy != SCHED_FAIR)
+    return;
+  p->vruntime += VTICK / niceweight[p->prio - NICE_MIN];
+  acquire(&ns->lock);
+  ns->vruntime += VTICK / ns->weight;
+  release(&ns->lock);
+}
+
+// Lock the run queue of this CPU, which a process must hold
+// to call sched().
+static void
+lockmyrq(void)
+{
+  pushcli();
+  acquire(&runqs[cpuid()].lock);
+  popcli();
+}
+
+// Release the run queue lock that the scheduler of this
+// CPU switched to us with.
+static void
+unlockmyrq(void)
+{
+  release(&runqs[cpuid()].lock);
+}
+
+// The CPU with the shortest run queue of those in mask.
+static int
+pickcpu(uint mask)
+{
+  int i, c;
+
+  c = -1;
+  for(i = 0; i < ncpu; i++)
+    if((mask & (1 << i)) && (c < 0 || runqs[i].n < runqs[c].n))
+      c = i;
+  return c;
+}
+
+// Make sure a CPU is up to run the work just queued on CPU c:
+// c itself if it is idle, or else an idle CPU to steal it.
+// The release of the run queue lock orders the queueing before
+// the reads of idle, as the xchg in idle() does the other way.
+static void
+wakecpu(int c)
+{
+  int i;
+
+  if(!cpus[c].idle){
+    if(runqs[c].n == 0)
+      return;
+    for(c = 0; c < ncpu && !cpus[c].idle; c++)
+      ;
+    if(c == ncpu)
+      return;
+  }
+  pushcli();
+  i = cpuid();
+  popcli();
+  if(c != i)
+    lapicipi(cpus[c].apicid, T_IRQ0 + IRQ_WAKE);
+}
+
+// Make p RUNNABLE on the run queue of its CPU. Caller must
+// hold the lock of p's wait queue, or ptable.lock for an
+// EMBRYO.
+static void
+makerunnable(struct proc *p)
+{
+  int c;
+  struct runq *rq;
+
+  c = p->cpu;
+  rq = &runqs[c];
+  acquire(&rq->lock);
+  p->state = RUNNABLE;
+  place(rq, p);
+  enqueue(rq, p);
+  release(&rq->lock);
+  wakecpu(c);
+}
+
+// Queue p, which has switched away and stayed RUNNABLE, on
+// the run queue of CPU p->cpu, where it has just moved. Unlike
+// makerunnable(), leaves its vruntime alone: it hasn't slept.
+// Caller must not hold a run queue lock.
+static void
+requeue(struct proc *p)
+{
+  int c;
+
+  c = p->cpu;
+  acquire(&runqs[c].lock);
+  enqueue(&runqs[c], p);
+  release(&runqs[c].lock);
+  wakecpu(c);
+}
+
+// Lock the run queue of p's CPU, which p can't leave while
+// it is held.
+static struct runq*
+lockrq(struct proc *p)
+{
+  struct runq *rq;
+
+  for(;;){
+    rq = &runqs[p->cpu];
+    acquire(&rq->lock);
+    if(rq == &runqs[p->cpu])
+      return rq;
+    release(&rq->lock);
+  }
+}
+
+// Remove a process that may run on CPU c from rq: the next
+// one to run there of those c's affinity allows. That is the
+// head of its list unless affinity masks leave it out, so this
+// is quick in the usual case.
+static struct proc*
+dequeuefor(struct runq *rq, int c)
+{
+  struct proc **pp, *p, *prev;
+  int i;
+
+  for(i = PRIO_MAX; i >= 0; i--){
+    prev = 0;
+    for(pp = &rq->prio[i]; (p = *pp) != 0; pp = &p->rqnext){
+      if(p->affinity & (1 << c)){
+        *pp = p->rqnext;
+        if(rq->priotail[i] == p)
+          rq->priotail[i] = prev;
+        goto found;
+      }
+      prev = p;
+    }
+  }
+
+  for(pp = &rq->fair; (p = *pp) != 0; pp = &p->rqnext)
+    if(p->affinity & (1 << c))
+      break;
+  if(p == 0)
+    return 0;
+  *pp = p->rqnext;
+
+found:
+  rq->n--;
+  p->rqnext = 0;
+  return p;
+}
+
+// Move a process from the longest run queue of another CPU to
+// that of CPU c, if c's is empty or at least two shorter.
+// Returns whether one moved. The caller must not hold a run
+// queue lock.
+static int
+steal(int c)
+{
+  struct runq *rq, *busiest;
+  struct proc *p;
+  int i;
+
+  busiest = 0;
+  for(i = 0; i < ncpu; i++){
+    rq = &runqs[i];
+    if(i != c && (busiest == 0 || rq->n > busiest->n))
+      busiest = rq;
+  }
+  if(busiest == 0 || busiest->n == 0 ||
+     (runqs[c].n > 0 && busiest->n < runqs[c].n + 2))
+    return 0;
+  acquire(&busiest->lock);
+  if((p = dequeuefor(busiest, c)) != 0)
+    p->cpu = c;
+  release(&busiest->lock);
+  if(p == 0)
+    return 0;
+  acquire(&runqs[c].lock);
+  enqueue(&runqs[c], p);
+  release(&runqs[c].lock);
+  return 1;
+}
+
+// Halt CPU c until an interrupt, unless it has work to run
+// or steal by now. Loads kpgdir first, so freevm() needn't wait
+// for a halted CPU.
+static void
+idle(struct cpu *c)
+{
+  int id;
+
+  cli();
+  id = c - cpus;
+  xchg(&c->idle, 1);
+  if(runqs[id].n > 0 || steal(id)){
+    c->idle = 0;
+    sti();
+    return;
+  }
+  switchkvm();
+  c->pgdir = 0;
+  c->uproc = 0;
+  if(id != 0)
+    lapictick(0);
+  stihlt();
+  cli();
+  c->idle = 0;
+  if(id != 0)
+    lapictick(1);
+  sti();
 }
 
 // Must be called with interrupts disabled
@@ -152,10 +709,10 @@ userinit(void)
   p = allocproc();
   
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((p->tg = tgalloc()) == 0 || (p->pgdir = setupkvm()) == 0)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
+  p->tg->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -166,10 +723,11 @@ userinit(void)
   p->tf->eip = 0;  // beginning of initcode.S
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
 
   // get a new nsproxy
-  p->nsproxy = create_nsproxy(NULL, true);
+  p->nsproxy = create_nsproxy(NULL, NULL, true);
+  p->tg->cwdmnt = get_mnt_namespace_root(p->nsproxy->mnt_ns);
+  p->tg->cwd = idup(p->tg->cwdmnt->rooti);
   // set pid
   p->pid = alloc_new_pid(p->nsproxy->pid_ns);
   // set pid namespace
@@ -181,32 +739,119 @@ userinit(void)
   // because the assignment might not be atomic.
   acquire(&ptable.lock);
 
-  p->state = RUNNABLE;
+  p->policy = SCHED_FAIR;
+  p->prio = 0;
+  p->vruntime = 0;
+  p->affinity = ~0;
+  p->cpu = 0;
+  hashpids(p);
+  makerunnable(p);
 
   release(&ptable.lock);
 }
 
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size on success, -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint sz, oldsz;
   struct proc *curproc = myproc();
+  struct tgroup *tg = curproc->tg;
 
-  sz = curproc->sz;
+again:
+  acquiresleep(&tg->vmlock);
+  sz = oldsz = tg->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(sz + n > mmapbase(curproc) || (sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      releasesleep(&tg->vmlock);
       return -1;
+    }
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(uvmbusy(sz + n, sz))
+      goto again;
+    if((sz = shrinkuvm(curproc->pgdir, sz, sz + n)) == 0){
+      releasesleep(&tg->vmlock);
       return -1;
+    }
   }
-  curproc->sz = sz;
-  switchuvm(curproc);
+  tg->sz = sz;
+  releasesleep(&tg->vmlock);
+  return oldsz;
+}
+
+// Keep the other threads in the group from unmapping [lo, hi)
+// until the current system call returns, so the kernel can use
+// that user memory once it has checked it. The pin must be made
+// before the check, or with the group's vmlock held.
+void
+pinuvm(uint lo, uint hi)
+{
+  struct proc *p = myproc();
+
+  // Only this thread could add another to the group.
+  if(p->tg->ref == 1 || lo >= hi)
+    return;
+  acquire(&ptable.lock);
+  if(p->pinlo == p->pinhi || lo < p->pinlo)
+    p->pinlo = lo;
+  if(hi > p->pinhi)
+    p->pinhi = hi;
+  release(&ptable.lock);
+}
+
+// Drop the current process's pins at the end of a system call.
+void
+unpinuvm(void)
+{
+  struct proc *p = myproc();
+
+  if(p->pinlo == p->pinhi)
+    return;
+  acquire(&ptable.lock);
+  p->pinlo = p->pinhi = 0;
+  release(&ptable.lock);
+  wakeup(p->tg);
+}
+
+// Whether another thread in curproc's group has pinned some of
+// [lo, hi). Caller holds ptable.lock.
+static int
+uvmpinned(struct proc *curproc, uint lo, uint hi)
+{
+  struct proc *p;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p != curproc && p->tg == curproc->tg && p->pinlo < hi && lo < p->pinhi)
+      return 1;
   return 0;
 }
 
+// Called with the group's vmlock held before unmapping [lo, hi).
+// If another thread's system call has some of it pinned, release
+// the vmlock, wait for the pins to go and return 1, so that the
+// caller starts over. Otherwise return 0.
+int
+uvmbusy(uint lo, uint hi)
+{
+  struct proc *curproc = myproc();
+
+  if(lo >= hi)
+    return 0;
+  acquire(&ptable.lock);
+  if(!uvmpinned(curproc, lo, hi)){
+    release(&ptable.lock);
+    return 0;
+  }
+  release(&ptable.lock);
+  releasesleep(&curproc->tg->vmlock);
+  acquire(&ptable.lock);
+  while(uvmpinned(curproc, lo, hi))
+    sleep(curproc->tg, &ptable.lock);
+  release(&ptable.lock);
+  return 1;
+}
+
 pid_namespace_struct* set_up_child_pid_namespace(struct proc * cur_process, struct proc * new_process){
   //get child_pid_namespace
   pid_namespace_struct* child_pid_namespace = cur_process->child_pid_namespace;
@@ -214,7 +859,7 @@ pid_namespace_struct* set_up_child_pid_namespace(struct proc * cur_process, stru
   //set child_pid_namespace
   if (child_pid_namespace) {// if we've prepared a new child_pid_namespace in current process
     //create a new nsproxy with child_pid_namespace
-    new_process->nsproxy = create_nsproxy(child_pid_namespace, true);
+    new_process->nsproxy = create_nsproxy(child_pid_namespace, cur_process->nsproxy->mnt_ns, true);
   } else {// if we've not prepared a new child_pid_namespace in current process
     //use old pid_namespace
     get_nsproxy(cur_process->nsproxy);
@@ -244,6 +889,25 @@ void set_up_pids(struct proc * proc, pid_namespace_struct* pid_namespace){
   }
 }
 
+// Make np, a new child of curproc, RUNNABLE on curproc's CPU,
+// scheduled as curproc is.
+static void
+startchild(struct proc *np, struct proc *curproc)
+{
+  acquire(&ptable.lock);
+
+  setparent(np, curproc);
+  hashpids(np);
+  np->policy = curproc->policy;
+  np->prio = curproc->prio;
+  np->vruntime = curproc->vruntime;
+  np->affinity = curproc->affinity;
+  np->cpu = curproc->cpu;
+  makerunnable(np);
+
+  release(&ptable.lock);
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -260,24 +924,50 @@ fork(void)
   }
 
   // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+  if((np->tg = tgalloc()) == 0){
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     return -1;
   }
-  np->sz = curproc->sz;
-  np->parent = curproc;
+  // Share the parent's memory copy-on-write, unless other
+  // threads could have the kernel write to it meanwhile
+  // (see checkuptr in syscall.c).
+  acquiresleep(&curproc->tg->vmlock);
+  if((np->pgdir = copyuvm(curproc->pgdir, curproc->tg->sz, curproc->tg->ref == 1)) == 0){
+    releasesleep(&curproc->tg->vmlock);
+    tgfree(np->tg);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  np->tg->sz = curproc->tg->sz;
+  if(mmapfork(np, curproc) < 0){
+    releasesleep(&curproc->tg->vmlock);
+    mmapclear(np, np->pgdir);
+    freevm(np->pgdir);
+    np->pgdir = 0;
+    tgfree(np->tg);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  releasesleep(&curproc->tg->vmlock);
   *np->tf = *curproc->tf;
   // TODO: copy namespace
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
+  acquire(&curproc->tg->lock);
   for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
+    if(curproc->tg->ofile[i])
+      np->tg->ofile[i] = filedup(curproc->tg->ofile[i]);
+  np->tg->cwd = idup(curproc->tg->cwd);
+  np->tg->cwdmnt = mntdup(curproc->tg->cwdmnt);
+  release(&curproc->tg->lock);
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -291,11 +981,106 @@ fork(void)
   np->pid = np->pids[0].pid;
   pid = get_namespace_pid(np, curproc->nsproxy->pid_ns);
 
-  acquire(&ptable.lock);
+  startchild(np, curproc);
 
-  np->state = RUNNABLE;
+  return pid;
+}
 
+// Create a thread of the current process: a child sharing its
+// page table, memory mappings, open files and current directory,
+// in its pid namespace, that starts by calling fn(arg) on the
+// stack below the address stack. fn must not return; the thread
+// ends with exit(), and its parent collects it with wait().
+int
+clone(uint fn, uint arg, uint stack)
+{
+  struct proc *np;
+  struct proc *curproc = myproc();
+  uint sp, ustack[2];
+
+  if(stack % 4 != 0)
+    return -1;
+  if((np = allocproc()) == 0)
+    return -1;
+
+  // Push arg and a return address that faults.
+  ustack[0] = 0xffffffff;
+  ustack[1] = arg;
+  sp = stack - sizeof(ustack);
+  acquiresleep(&curproc->tg->vmlock);
+  if(stack < sizeof(ustack) || copyout(curproc->pgdir, sp, ustack, sizeof(ustack)) < 0){
+    releasesleep(&curproc->tg->vmlock);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  releasesleep(&curproc->tg->vmlock);
+
+  acquire(&ptable.lock);
+  curproc->tg->ref++;
   release(&ptable.lock);
+  np->tg = curproc->tg;
+  np->pgdir = curproc->pgdir;
+  *np->tf = *curproc->tf;
+  np->tf->eip = fn;
+  np->tf->esp = sp;
+  np->tf->eax = 0;
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  get_nsproxy(curproc->nsproxy);
+  np->nsproxy = curproc->nsproxy;
+  set_up_pids(np, curproc->nsproxy->pid_ns);
+  np->pid = np->pids[0].pid;
+
+  startchild(np, curproc);
+
+  return np->pid;
+}
+
+// Create a child running the program at path with arguments
+// argv, like fork() followed by exec() but without copying the
+// current process. The child's file descriptor i is fd[i] for
+// i < nfd, closed if fd[i] is 0; the others are closed.
+int
+spawn(char *path, char **argv, struct file **fd, int nfd)
+{
+  int i, pid;
+  uint sz;
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+  if((np->tg = tgalloc()) == 0){
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  *np->tf = *curproc->tf;
+  if((np->pgdir = loadprog(np, path, argv, &sz)) == 0){
+    tgfree(np->tg);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  np->tg->sz = sz;
+
+  for(i = 0; i < nfd; i++)
+    if(fd[i])
+      np->tg->ofile[i] = filedup(fd[i]);
+  acquire(&curproc->tg->lock);
+  np->tg->cwd = idup(curproc->tg->cwd);
+  np->tg->cwdmnt = mntdup(curproc->tg->cwdmnt);
+  release(&curproc->tg->lock);
+
+  set_up_pids(np, set_up_child_pid_namespace(curproc, np));
+  np->pid = np->pids[0].pid;
+  pid = get_namespace_pid(np, curproc->nsproxy->pid_ns);
+
+  startchild(np, curproc);
 
   return pid;
 }
@@ -304,11 +1089,9 @@ void kill_process(struct proc* proc, struct proc* new_parent) {
   //set proc is killed
   proc->killed = true;
   //set proc new parent
-  proc->parent = new_parent;
+  setparent(proc, new_parent);
   //set proc state
-  if (proc->state == SLEEPING){
-    proc->state = RUNNABLE;
-  }
+  wakeproc(proc);
 }
 
 // Exit the current process.  Does not return.
@@ -319,8 +1102,10 @@ exit(int exit_state)
 {
   struct proc *curproc = myproc();
   struct proc *p;
+  struct tgroup *tg = curproc->tg;
+  struct pid_entry *e;
   pid_namespace_struct *cur_pid_namespace;
-  int fd;
+  int fd, last, i;
 
   //set exit state
   curproc->exit_state = exit_state;
@@ -328,34 +1113,34 @@ exit(int exit_state)
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
-  }
+  // The last thread of the group to exit takes the group's files,
+  // mappings and current directory with it. Its page table goes
+  // when wait() frees it. No thread can join meanwhile.
+  acquire(&ptable.lock);
+  last = tg->ref == 1;
+  if(!last)
+    tg->ref--;
+  release(&ptable.lock);
 
-  begin_op();
-  iput(curproc->cwd);
-  end_op();
-  curproc->cwd = 0;
+  if(last){
+    // Close all open files.
+    for(fd = 0; fd < NOFILE; fd++){
+      if(tg->ofile[fd]){
+        fileclose(tg->ofile[fd]);
+        tg->ofile[fd] = 0;
+      }
+    }
 
-  // mntput(curproc->cwdmnt);
-  // curproc->cwdmnt = 0;
+    mmapclear(curproc, curproc->pgdir);
 
-  // try to find process with pid = 1 in current pid_namespace
-  struct proc* proc_with_pid_1 = NULL;
-  for (int i = 0; i < NPROC; ++i) {// iterate through all processes
-    struct proc* proc = &ptable.proc[i];
-    if(get_namespace_pid(proc, curproc->nsproxy->pid_ns) == 1){
-      proc_with_pid_1 = proc;
-    }
+    begin_op();
+    iput(tg->cwd);
+    mntput(tg->cwdmnt);
+    end_op();
+    tgfree(tg);
   }
+  curproc->tg = 0;
 
-  // check if we can find the process with pid 1 in target ns
-  if (proc_with_pid_1 == NULL && curproc->nsproxy->pid_ns->is_pid_1_killed == false)
-    panic("can not find process with pid 1 in target namespace");
   cur_pid_namespace = curproc->nsproxy->pid_ns;
 
   // remove namespace
@@ -363,29 +1148,35 @@ exit(int exit_state)
 
   acquire(&ptable.lock);
 
+  // try to find process with pid = 1 in current pid_namespace
+  struct proc* proc_with_pid_1 = findpid(cur_pid_namespace, 1);
+
+  // check if we can find the process with pid 1 in target ns
+  if (proc_with_pid_1 == NULL && cur_pid_namespace->is_pid_1_killed == false)
+    panic("can not find process with pid 1 in target namespace");
+
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup(curproc->parent);
 
   if (curproc->pid == 1) { // kill all child process if pid is 1 for current process
-    for(int i = 0; i < NPROC; ++i){
-      struct proc *proc = &ptable.proc[i];
-      //kill process
-      if(proc != curproc && proc->nsproxy->pid_ns == cur_pid_namespace) {
-        kill_process(proc, curproc->parent);
+    for(i = 0; i < NPIDHASH; ++i){
+      for(e = cur_pid_namespace->pidhash[i]; e != NULL; e = e->hnext){
+        //kill process
+        if(e->proc != curproc && procns(e->proc) == cur_pid_namespace) {
+          kill_process(e->proc, curproc->parent);
+        }
       }
     }
     // Mark pid 1 process was killed
     cur_pid_namespace->is_pid_1_killed = true;
-
-  } else { // The current process does not hold pid 1 within its namespace
-    // Pass the child processes of the current process to pid 1 process within the namespace
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent == curproc){
-        p->parent = proc_with_pid_1;
-        if(p->state == ZOMBIE) {
-          wakeup1(initproc);
-        }
-      }
+    // Children in namespaces of their own go the same way
+    proc_with_pid_1 = curproc->parent;
+  }
+  // Pass the child processes of the current process to pid 1 process within the namespace
+  while((p = curproc->child) != NULL){
+    setparent(p, proc_with_pid_1);
+    if(p->state == ZOMBIE && proc_with_pid_1 != NULL) {
+      wakeup(proc_with_pid_1);
     }
   }
 
@@ -393,56 +1184,99 @@ exit(int exit_state)
     remove_from_pid_namespace(curproc->child_pid_namespace);
 
   // Jump into the scheduler, never to return.
+  // wait() can't free us before the switch is done,
+  // which releases our CPU's run queue lock.
+  if(!last)
+    curproc->pgdir = 0;  // still in use by the other threads
   curproc->state = ZOMBIE;
+  if(curproc->parent)
+    addzombie(curproc);
+  lockmyrq();
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
+// Free p, a zombie child of curproc, and return its pid.
+// Caller holds ptable.lock.
+static int
+reap(struct proc *p, struct proc *curproc)
+{
+  int pid;
+
+  // Wait for it to finish switching away.
+  acquire(&runqs[p->cpu].lock);
+  release(&runqs[p->cpu].lock);
+  pid = get_namespace_pid(p, curproc->nsproxy->pid_ns);
+  kfree(p->kstack);
+  p->kstack = 0;
+  if(p->pgdir)
+    freevm(p->pgdir);
+  p->pgdir = 0;
+  p->pid = 0;
+  unhashpids(p);
+  memset(p->pids, 0, sizeof(p->pids));
+  setparent(p, NULL);
+  p->killed = false;
+  p->state = UNUSED;
+  p->name[0] = 0;
+  p->child_pid_namespace = NULL;
+  p->exit_state = 0;
+  return pid;
+}
+
+// Wait for the child process with the given pid, or for any
+// child if pid is -1, to exit, and return its pid, with its
+// exit state in *status if status isn't 0. With WNOHANG in
+// options, return 0 at once if no such child has exited yet.
+// Return -1 if there is no such child.
 int
-wait(void)
+waitpid(int pid, int *status, int options)
 {
   struct proc *p;
-  int havekids, pid;
   struct proc *curproc = myproc();
-  
+  int xstate;
+
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
-        continue;
-      havekids = 1;
-      if(p->state == ZOMBIE){
-        // Found one.
-        pid = get_namespace_pid(p, curproc->nsproxy->pid_ns);
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        memset(p->pids, 0, sizeof(p->pids));
-        p->parent = NULL;
-        p->killed = false;
-        p->state = UNUSED;
-        p->name[0] = 0;
-        p->child_pid_namespace = NULL;
-        p->exit_state = 0;
-        release(&ptable.lock);
-        return pid;
-      }
+    if(pid == -1){
+      p = curproc->zombies;
+      if(curproc->child == 0)
+        break;
+    } else {
+      p = findpid(curproc->nsproxy->pid_ns, pid);
+      if(p == 0 || p->parent != curproc)
+        break;
+    }
+    if(p != 0 && p->state == ZOMBIE){
+      xstate = p->exit_state;
+      pid = reap(p, curproc);
+      release(&ptable.lock);
+      if(status)
+        *status = xstate;
+      return pid;
     }
 
-    // No point waiting if we don't have any children.
-    if(!havekids || curproc->killed){
+    if(curproc->killed)
+      break;
+    if(options & WNOHANG){
       release(&ptable.lock);
-      return -1;
+      return 0;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    // Wait for children to exit.  (See wakeup call in exit.)
     sleep(curproc, &ptable.lock);  //DOC: wait-sleep
   }
+  release(&ptable.lock);
+  return -1;
+}
+
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(void)
+{
+  return waitpid(-1, 0, 0);
 }
 
 //PAGEBREAK: 42
@@ -458,39 +1292,64 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  struct runq *rq = &runqs[id];
   c->proc = 0;
   
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
-
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      c->proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-
-      swtch(&(c->scheduler), p->context);
-      switchkvm();
+    // Even out the load with the busiest CPU, then take
+    // the next process off this CPU's run queue, or else
+    // wait for some.
+    steal(id);
+    acquire(&rq->lock);
+    if((p = dequeue(rq)) == 0){
+      release(&rq->lock);
+      idle(c);
+      continue;
+    }
 
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      c->proc = 0;
+    // A process woken here after its affinity left this CPU
+    // out has switched away by now, so it can move.
+    if(!(p->affinity & (1 << id))){
+      p->cpu = pickcpu(p->affinity);
+      release(&rq->lock);
+      requeue(p);
+      continue;
     }
-    release(&ptable.lock);
 
+    // Switch to chosen process.  It is the process's job
+    // to release rq->lock and then reacquire it
+    // before jumping back to us. If it is the last
+    // process to have run here and hasn't run anywhere
+    // since, its page table and TSS are still loaded,
+    // and its TLB entries still good.
+    c->proc = p;
+    if(p != c->uproc || p->pgdir != c->pgdir || p->runseq != c->runseq)
+      switchuvm(p);
+    c->runseq = ++p->runseq;
+    p->state = RUNNING;
+
+    swtch(&(c->scheduler), p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    // A process that yielded to move to another CPU is
+    // queued there now that it has switched away.
+    c->proc = 0;
+    if(p->state == RUNNABLE && p->cpu != id){
+      release(&rq->lock);
+      requeue(p);
+      continue;
+    }
+    release(&rq->lock);
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
-// and have changed proc->state. Saves and restores
+// Enter scheduler.  Must hold only the run queue lock of this
+// CPU and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
 // be proc->intena and proc->ncli, but that would
@@ -502,8 +1361,8 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&runqs[cpuid()].lock))
+    panic("sched runq lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
   if(p->state == RUNNING)
@@ -515,14 +1374,22 @@ sched(void)
   mycpu()->intena = intena;
 }
 
-// Give up the CPU for one scheduling round.
+// Give up the CPU at the end of a clock tick. A process whose
+// affinity no longer allows this CPU moves to one it allows.
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  myproc()->state = RUNNABLE;
+  struct proc *p = myproc();
+
+  lockmyrq();  //DOC: yieldlock
+  charge(p);
+  p->state = RUNNABLE;
+  if(p->affinity & (1 << p->cpu))
+    enqueue(&runqs[p->cpu], p);
+  else
+    p->cpu = pickcpu(p->affinity);  // scheduler() queues it there
   sched();
-  release(&ptable.lock);
+  unlockmyrq();
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -531,8 +1398,8 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding the run queue lock from scheduler.
+  unlockmyrq();
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -552,6 +1419,7 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq;
   
   if(p == 0)
     panic("sleep");
@@ -559,52 +1427,129 @@ sleep(void *chan, struct spinlock *lk)
   if(lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
+  // Must acquire the lock of chan's wait queue in order
+  // to change p->state and then call sched.
+  // Once we hold it, we can be guaranteed that we
+  // won't miss any wakeup (wakeup runs with it locked),
+  // so it's okay to release lk. A wakeup after the wait
+  // queue lock is released waits for the switch on our
+  // run queue lock.
+  wq = waitq(chan);
+  acquire(&wq->lock);  //DOC: sleeplock1
+  release(lk);
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->wnext = wq->head;
+  wq->head = p;
+  lockmyrq();
+  release(&wq->lock);
 
   sched();
 
   // Tidy up.
+  unlockmyrq();
   p->chan = 0;
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  acquire(lk);  //DOC: sleeplock2
 }
 
 //PAGEBREAK!
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
-static void
-wakeup1(void *chan)
+// Wake up at most n processes sleeping on chan, all if n < 0.
+// Returns how many woke.
+static int
+wakeupn(void *chan, int n)
 {
-  struct proc *p;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  struct waitq *wq = waitq(chan);
+  struct proc **pp, *p;
+  int woken = 0;
+
+  acquire(&wq->lock);
+  for(pp = &wq->head; (p = *pp) != 0 && woken != n; ){
+    if(p->chan == chan){
+      *pp = p->wnext;
+      p->wnext = 0;
+      makerunnable(p);
+      woken++;
+    } else {
+      pp = &p->wnext;
+    }
+  }
+  release(&wq->lock);
+  return woken;
 }
 
 // Wake up all processes sleeping on chan.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  wakeupn(chan, -1);
+}
+
+// FUTEX_WAIT: sleep while the word at user address addr holds
+// val; FUTEX_WAKE: wake up to val processes sleeping on it.
+// They sleep on the word's kernel address, so processes that
+// share the page through mmap() can use it too, not only
+// threads. Returns the number woken, 0 after sleeping, or -1.
+int
+futex(uint addr, int op, int val)
+{
+  char *page;
+  int *word;
+  int r;
+
+  if(addr % sizeof(int) != 0)
+    return -1;
+  // A copy-on-write page would move on the first write to it.
+  if(cowcheck(addr, sizeof(int)) < 0 ||
+     (page = uva2ka(myproc()->pgdir, (char*)PGROUNDDOWN(addr))) == 0)
+    return -1;
+  word = (int*)(page + addr % PGSIZE);
+  // Reading the word through its kernel address can't fault, so
+  // don't hold up another thread's munmap() while asleep on it.
+  unpinuvm();
+
+  acquire(&futexlock);
+  switch(op){
+  case FUTEX_WAIT:
+    r = -1;
+    if(*word == val){
+      sleep(word, &futexlock);
+      r = 0;
+    }
+    break;
+  case FUTEX_WAKE:
+    r = wakeupn(word, val);
+    break;
+  default:
+    r = -1;
+  }
+  release(&futexlock);
+  return r;
+}
+
+// Wake up p if it is sleeping, whatever on.
+static void
+wakeproc(struct proc *p)
+{
+  struct waitq *wq;
+  struct proc **pp;
+  void *chan;
+
+  while(p->state == SLEEPING){
+    chan = p->chan;
+    wq = waitq(chan);
+    acquire(&wq->lock);
+    if(p->state == SLEEPING && p->chan == chan){
+      for(pp = &wq->head; *pp != p; pp = &(*pp)->wnext)
+        ;
+      *pp = p->wnext;
+      p->wnext = 0;
+      makerunnable(p);
+    }
+    release(&wq->lock);
+  }
 }
 
 // Kill the process with the given pid.
@@ -617,17 +1562,124 @@ kill(int pid)
 
   acquire(&ptable.lock);
   pid_namespace_struct* pid_ns = myproc()->nsproxy->pid_ns;
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(get_namespace_pid(p, pid_ns) == pid){
-       kill_process(p, p->parent);
-       release(&ptable.lock);
-       return 0;
-    }
+  if((p = findpid(pid_ns, pid)) != 0){
+     kill_process(p, p->parent);
+     release(&ptable.lock);
+     return 0;
+  }
+  release(&ptable.lock);
+  return -1;
+}
+
+// May processes in pid namespace ns change how much CPU those
+// in namespace of get? Only if ns is the root or an ancestor of of.
+static int
+nsgoverns(pid_namespace_struct *ns, pid_namespace_struct *of)
+{
+  pid_namespace_struct *a;
+
+  if(ns->parent == 0)
+    return 1;
+  for(a = of->parent; a != 0 && a != ns; a = a->parent)
+    ;
+  return a != 0;
+}
+
+// Set the scheduling policy and nice level or priority of the
+// process with the given pid, 0 for the caller, or with
+// SCHED_SHARE the CPU weight of its pid namespace. Fixed
+// priorities run ahead of every namespace's share, so only the
+// root namespace and ancestors of a namespace can set them or
+// its weight.
+int
+setsched(int pid, int policy, int value)
+{
+  struct proc *p, *curproc = myproc();
+  pid_namespace_struct *ns;
+  struct runq *rq;
+
+  acquire(&ptable.lock);
+  if(pid == 0)
+    p = curproc;
+  else
+    p = findpid(curproc->nsproxy->pid_ns, pid);
+  if(p == 0 || p->state == ZOMBIE)
+    goto bad;
+
+  switch(policy){
+  case SCHED_FAIR:
+    if(value < NICE_MIN || value > NICE_MAX)
+      goto bad;
+    break;
+  case SCHED_PRIO:
+    if(value < 0 || value > PRIO_MAX)
+      goto bad;
+    if(!nsgoverns(curproc->nsproxy->pid_ns, procns(p)))
+      goto bad;
+    break;
+  case SCHED_SHARE:
+    if(value < 1 || value > SHARE_MAX)
+      goto bad;
+    ns = procns(p);
+    if(!nsgoverns(curproc->nsproxy->pid_ns, ns))
+      goto bad;
+    acquire(&ns->lock);
+    ns->weight = value;
+    release(&ns->lock);
+    release(&ptable.lock);
+    return 0;
+  default:
+    goto bad;
   }
+
+  // A queued process stays on the list it joined, so
+  // the change takes effect when it next joins one.
+  rq = lockrq(p);
+  p->policy = policy;
+  p->prio = value;
+  release(&rq->lock);
+  release(&ptable.lock);
+  return 0;
+
+bad:
   release(&ptable.lock);
   return -1;
 }
 
+// Restrict the process with the given pid, 0 for the caller,
+// to the CPUs in mask. It moves off a CPU the mask leaves out
+// when it next yields, or is next picked there after waking.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p, *curproc = myproc();
+
+  mask &= (1 << ncpu) - 1;
+  if(mask == 0)
+    return -1;
+  acquire(&ptable.lock);
+  if(pid == 0)
+    p = curproc;
+  else
+    p = findpid(curproc->nsproxy->pid_ns, pid);
+  if(p == 0 || p->state == ZOMBIE){
+    release(&ptable.lock);
+    return -1;
+  }
+  p->affinity = mask;
+  release(&ptable.lock);
+
+  if(p == curproc){
+    pushcli();
+    if(!(mask & (1 << cpuid()))){
+      popcli();
+      yield();
+    } else
+      popcli();
+  }
+  return 0;
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
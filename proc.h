@@ -9,6 +9,12 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  volatile uint idle;          // Halted in scheduler() for want of work?
+  pde_t *volatile pgdir;       // User page table in %cr3, or 0 for kpgdir
+  struct proc *uproc;          // Process whose page table and TSS are loaded
+  uint runseq;                 // runseq of uproc when it loaded them
+  volatile uint flushreq;      // TLB flushes asked for by tlbflush()
+  volatile uint flushdone;     // flushreq as of the last flush
 };
 
 extern struct cpu cpus[NCPU];
@@ -38,24 +44,48 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 struct pid_entry {
   pid_namespace_struct* pid_ns;
   int pid;
+  struct proc *proc;           // Process this is a pid of
+  struct pid_entry *hnext;     // Next in pid_ns->pidhash bucket
+};
+
+// A file mapped into a process by mmap().
+struct vma {
+  uint start;                  // first address, page aligned
+  uint end;                    // address after the last page
+  uint off;                    // file offset mapped at start
+  int prot;                    // PROT_READ and/or PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE
+  struct file *f;              // 0 if the slot is unused
 };
 
 // Per-process state
 struct proc {
 
-  uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
   struct proc *parent;         // Parent process
+  struct proc *child;          // First child
+  struct proc *sibnext;        // Next child of parent
+  struct proc *sibprev;        // Previous child of parent
+  struct proc *zombies;        // Children that have exited
+  struct proc *znext;          // Next in parent's zombies
+  struct proc *zprev;          // Previous in parent's zombies
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
+  int cpu;                     // CPU it runs or last ran on, whose run queue it joins
+  struct proc *rqnext;         // Next on the run queue
+  int policy;                  // SCHED_FAIR or SCHED_PRIO
+  int prio;                    // Nice level or fixed priority, by policy
+  uint vruntime;               // CPU time scaled by 1/weight of nice level
+  uint affinity;               // Bit i set if it may run on CPU i
+  uint runseq;                 // Times it has been scheduled
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *wnext;          // Next sleeper in chan's wait queue
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
-  // struct mntent *cwdmnt;
+  struct tgroup *tg;           // Memory, open files and cwd, shared by threads
+  uint pinlo, pinhi;           // User memory the current syscall uses (see pinuvm)
   char name[16];               // Process name (debugging)
 
   nsproxy_struct *nsproxy;     // Namespace proxy object
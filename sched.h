@@ -0,0 +1,11 @@
+// setsched() policies.
+#define SCHED_FAIR  0  // value is a nice level, NICE_MIN..NICE_MAX
+#define SCHED_PRIO  1  // value is a fixed priority, 0..PRIO_MAX
+#define SCHED_SHARE 2  // value is the CPU weight of the process's pid namespace
+
+#define NICE_MIN  (-20)
+#define NICE_MAX  19
+#define PRIO_MAX  7
+
+#define SHARE_DEFAULT 100
+#define SHARE_MAX     10000
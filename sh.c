@@ -52,12 +52,43 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
+
+// Start cmd with spawn() instead of fork() and exec() if it is
+// a single program, perhaps with redirections. It gets fd[0-2]
+// as its descriptors 0-2. Returns its pid, or -1 if cmd is
+// anything else or can't be spawned, to be run the usual way.
+int
+spawncmd(struct cmd *cmd, int *fd)
+{
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  int nfd[3], pid;
+
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0] == 0)
+      return -1;
+    return spawn(ecmd->argv[0], ecmd->argv, fd, 3);
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    memmove(nfd, fd, sizeof(nfd));
+    if((nfd[rcmd->fd] = open(rcmd->file, rcmd->mode)) < 0)
+      return -1;
+    pid = spawncmd(rcmd->cmd, nfd);
+    close(nfd[rcmd->fd]);
+    return pid;
+  }
+  return -1;
+}
 
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
 {
-  int p[2];
+  int p[2], fd[3];
   struct backcmd *bcmd;
   struct execcmd *ecmd;
   struct listcmd *lcmd;
@@ -101,14 +132,19 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
+    fd[0] = 0;
+    fd[1] = p[1];
+    fd[2] = 2;
+    if(spawncmd(pcmd->left, fd) < 0 && fork1() == 0){
       close(1);
       dup(p[1]);
       close(p[0]);
       close(p[1]);
       runcmd(pcmd->left);
     }
-    if(fork1() == 0){
+    fd[0] = p[0];
+    fd[1] = 1;
+    if(spawncmd(pcmd->right, fd) < 0 && fork1() == 0){
       close(0);
       dup(p[0]);
       close(p[0]);
@@ -145,6 +181,8 @@ int
 main(void)
 {
   static char buf[100];
+  static int stdfd[3] = {0, 1, 2};
+  struct cmd *cmd;
   int fd;
 
   // Ensure that three file descriptors are open.
@@ -164,9 +202,12 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
+    if((cmd = parsecmd(buf)) == 0)
+      continue;
+    if(spawncmd(cmd, stdfd) < 0 && fork1() == 0)
+      runcmd(cmd);
     wait();
+    freecmd(cmd);
   }
   exit(0);
 }
@@ -261,6 +302,17 @@ backcmd(struct cmd *subcmd)
 
 char whitespace[] = " \t\r\n\v";
 char symbols[] = "<|>&;()";
+int parseerr;
+
+// Report a syntax error. The shell parses commands itself, so
+// parsing goes on, and then parsecmd() fails.
+void
+syntax(char *s)
+{
+  if(!parseerr)
+    printf(2, "%s\n", s);
+  parseerr = 1;
+}
 
 int
 gettoken(char **ps, char *es, char **q, char **eq)
@@ -330,12 +382,17 @@ parsecmd(char *s)
   char *es;
   struct cmd *cmd;
 
+  parseerr = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !parseerr){
     printf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(parseerr){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -380,7 +437,7 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
     if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+      syntax("missing file for redirection");
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -406,7 +463,7 @@ parseblock(char **ps, char *es)
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
   if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+    syntax("syntax - missing )");
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -432,12 +489,14 @@ parseexec(char **ps, char *es)
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
     if(tok != 'a')
-      panic("syntax");
+      syntax("syntax");
+    if(argc >= MAXARGS-1){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -491,3 +550,40 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+void
+freecmd(struct cmd *cmd)
+{
+  struct backcmd *bcmd;
+  struct listcmd *lcmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    freecmd(rcmd->cmd);
+    break;
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    freecmd(pcmd->left);
+    freecmd(pcmd->right);
+    break;
+
+  case LIST:
+    lcmd = (struct listcmd*)cmd;
+    freecmd(lcmd->left);
+    freecmd(lcmd->right);
+    break;
+
+  case BACK:
+    bcmd = (struct backcmd*)cmd;
+    freecmd(bcmd->cmd);
+    break;
+  }
+  free(cmd);
+}
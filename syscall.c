@@ -6,6 +6,10 @@
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
+#include "uio.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "tgroup.h"
 
 // User code makes a system call with INT T_SYSCALL.
 // System call number in %eax.
@@ -13,16 +17,31 @@
 // library system call function. The saved user %esp points
 // to a saved program counter, and then the first argument.
 
+// Other threads in the group can shrink the heap or unmap files
+// while a system call runs. The kernel would fault on memory they
+// took away after it was checked, so the checks below pin what
+// they pass until the system call returns (see pinuvm), and hold
+// the group's vmlock while looking at its size.
+
 // Fetch the int at addr from the current process.
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
+  struct tgroup *tg = myproc()->tg;
+  int r, shared;
 
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
-    return -1;
-  *ip = *(int*)(addr);
-  return 0;
+  // Only this thread could add to the group, so the vmlock
+  // isn't needed if there are no others now.
+  if((shared = tg->ref > 1))
+    acquiresleep(&tg->vmlock);
+  r = -1;
+  if(addr < tg->sz && addr+4 <= tg->sz){
+    *ip = *(int*)(addr);
+    r = 0;
+  }
+  if(shared)
+    releasesleep(&tg->vmlock);
+  return r;
 }
 
 // Fetch the nul-terminated string at addr from the current process.
@@ -32,17 +51,26 @@ int
 fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
-  struct proc *curproc = myproc();
+  struct tgroup *tg = myproc()->tg;
+  int r, shared;
 
-  if(addr >= curproc->sz)
-    return -1;
-  *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
-    if(*s == 0)
-      return s - *pp;
+  if((shared = tg->ref > 1))
+    acquiresleep(&tg->vmlock);
+  r = -1;
+  if(addr < tg->sz){
+    *pp = (char*)addr;
+    ep = (char*)tg->sz;
+    for(s = *pp; s < ep; s++){
+      if(*s == 0){
+        r = s - *pp;
+        pinuvm(addr, addr+r+1);
+        break;
+      }
+    }
   }
-  return -1;
+  if(shared)
+    releasesleep(&tg->vmlock);
+  return r;
 }
 
 // Fetch the nth 32-bit system call argument.
@@ -52,6 +80,31 @@ argint(int n, int *ip)
   return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
+// Check that the size bytes at addr lie within the process
+// address space: in its heap, or in memory-mapped files, which
+// are then mapped in so the kernel doesn't fault on them.
+// If the kernel will write there, write must be set, and
+// copy-on-write pages are copied now for the same reason.
+static int
+checkuptr(uint addr, int size, int write)
+{
+  struct tgroup *tg = myproc()->tg;
+  uint sz;
+
+  if(size < 0)
+    return -1;
+  pinuvm(addr, addr+size);
+  if(tg->ref > 1){
+    acquiresleep(&tg->vmlock);
+    sz = tg->sz;
+    releasesleep(&tg->vmlock);
+  } else
+    sz = tg->sz;
+  if(addr < sz && addr+size <= sz && addr+size >= addr)
+    return write ? cowcheck(addr, size) : 0;
+  return mmapcheck(addr, size, write);
+}
+
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
 // lies within the process address space.
@@ -59,20 +112,57 @@ int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
- 
+
+  if(argint(n, &i) < 0)
+    return -1;
+  if(checkuptr(i, size, 0) < 0)
+    return -1;
+  *pp = (char*)i;
+  return 0;
+}
+
+// Like argptr, for memory the system call will write to.
+int
+argwptr(int n, char **pp, int size)
+{
+  int i;
+
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(checkuptr(i, size, 1) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// Fetch the nth word-sized system call argument as a pointer to
+// an array of cnt iovecs, and copy the array into iov.  Check
+// that the array and every buffer it names lie within the
+// process address space; write is set if the buffers will be
+// written to.
+int
+argiov(int n, int cnt, struct iovec *iov, int write)
+{
+  int i;
+  char *p;
+
+  if(cnt < 0 || cnt > UIO_MAXIOV || argptr(n, &p, cnt*sizeof(struct iovec)) < 0)
+    return -1;
+  memmove(iov, p, cnt*sizeof(struct iovec));
+  for(i = 0; i < cnt; i++){
+    if(iov[i].iov_len == 0)
+      continue;
+    if((int)iov[i].iov_len < 0 || checkuptr((uint)iov[i].iov_base, iov[i].iov_len, write) < 0)
+      return -1;
+  }
+  return 0;
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this assert_non_negtive and being used by the kernel.)
+// (Another thread sharing the memory can still change the string
+// after this check, but not unmap it; the kernel must not assume
+// its length stays the same.)
 int
 argstr(int n, char **pp)
 {
@@ -106,6 +196,22 @@ extern int sys_uptime(void);
 extern int sys_unshare(void);
 extern int sys_mount(void);
 extern int sys_umount(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_splice(void);
+extern int sys_fcntl(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_fsync(void);
+extern int sys_fdatasync(void);
+extern int sys_setsched(void);
+extern int sys_setaffinity(void);
+extern int sys_clone(void);
+extern int sys_futex(void);
+extern int sys_spawn(void);
+extern int sys_waitpid(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -132,6 +238,22 @@ static int (*syscalls[])(void) = {
 [SYS_mount]   sys_mount,
 [SYS_umount]  sys_umount,
 [SYS_unshare] sys_unshare,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_splice]  sys_splice,
+[SYS_fcntl]   sys_fcntl,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_fsync]   sys_fsync,
+[SYS_fdatasync] sys_fdatasync,
+[SYS_setsched] sys_setsched,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_clone]   sys_clone,
+[SYS_futex]   sys_futex,
+[SYS_spawn]   sys_spawn,
+[SYS_waitpid] sys_waitpid,
 };
 
 void
@@ -143,6 +265,7 @@ syscall(void)
   num = curproc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();
+    unpinuvm();
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             curproc->pid, curproc->name, num);
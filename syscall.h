@@ -23,3 +23,19 @@
 #define SYS_unshare 24
 #define SYS_mount  22
 #define SYS_umount 23
+#define SYS_readv  25
+#define SYS_writev 26
+#define SYS_pread  27
+#define SYS_pwrite 28
+#define SYS_splice 29
+#define SYS_fcntl  30
+#define SYS_mmap   31
+#define SYS_munmap 32
+#define SYS_fsync  33
+#define SYS_fdatasync 34
+#define SYS_setsched 35
+#define SYS_setaffinity 36
+#define SYS_clone  37
+#define SYS_futex  38
+#define SYS_spawn  39
+#define SYS_waitpid 40
@@ -13,11 +13,32 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "tgroup.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
+
+// The file open as fd, with a reference that keeps it open if
+// another thread closes fd; the caller drops it with fileclose().
+// Returns 0 if fd isn't open.
+static struct file*
+fdget(int fd)
+{
+  struct file *f;
+  struct tgroup *tg = myproc()->tg;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  acquire(&tg->lock);
+  if((f = tg->ofile[fd]) != 0)
+    filedup(f);
+  release(&tg->lock);
+  return f;
+}
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return both the descriptor and the corresponding struct file,
+// which the caller must fileclose() when done with it.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
@@ -26,12 +47,14 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
   if(pf)
     *pf = f;
+  else
+    fileclose(f);
   return 0;
 }
 
@@ -41,14 +64,17 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *curproc = myproc();
+  struct tgroup *tg = myproc()->tg;
 
+  acquire(&tg->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
+    if(tg->ofile[fd] == 0){
+      tg->ofile[fd] = f;
+      release(&tg->lock);
       return fd;
     }
   }
+  release(&tg->lock);
   return -1;
 }
 
@@ -60,9 +86,10 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -70,24 +97,180 @@ int
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argint(2, &n) < 0 || argwptr(1, &p, n) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 int
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
+  char *p;
+
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  int cnt, r;
+  struct iovec iov[UIO_MAXIOV];
+
+  if(argint(2, &cnt) < 0 || argiov(1, cnt, iov, 1) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filereadv(f, iov, cnt);
+  fileclose(f);
+  return r;
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  int cnt, r;
+  struct iovec iov[UIO_MAXIOV];
+
+  if(argint(2, &cnt) < 0 || argiov(1, cnt, iov, 0) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filewritev(f, iov, cnt);
+  fileclose(f);
+  return r;
+}
+
+int
+sys_pread(void)
+{
+  struct file *f;
+  int n, off, r;
+  char *p;
+
+  if(argint(2, &n) < 0 || argwptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = filepread(f, p, n, off);
+  fileclose(f);
+  return r;
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off, r;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return filewrite(f, p, n);
+  r = filepwrite(f, p, n, off);
+  fileclose(f);
+  return r;
+}
+
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n, r;
+
+  if(argint(2, &n) < 0 || argfd(0, 0, &in) < 0)
+    return -1;
+  if(argfd(1, 0, &out) < 0){
+    fileclose(in);
+    return -1;
+  }
+  r = filesplice(in, out, n);
+  fileclose(in);
+  fileclose(out);
+  return r;
+}
+
+int
+sys_fsync(void)
+{
+  struct file *f;
+  int r;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  r = filesync(f, 0);
+  fileclose(f);
+  return r;
+}
+
+int
+sys_fdatasync(void)
+{
+  struct file *f;
+  int r;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  r = filesync(f, 1);
+  fileclose(f);
+  return r;
+}
+
+int
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg, r;
+
+  if(argint(1, &cmd) < 0 || argint(2, &arg) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  r = -1;
+  if(f->type == FD_PIPE){
+    switch(cmd){
+    case F_GETPIPE_SZ:
+      r = pipegetsize(f->pipe);
+      break;
+    case F_SETPIPE_SZ:
+      r = pipesetsize(f->pipe, arg);
+      break;
+    }
+  }
+  fileclose(f);
+  return r;
+}
+
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int addr, len, prot, flags, off, r;
+
+  // addr is only a hint, which is ignored
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len <= 0 || off < 0 || argfd(4, 0, &f) < 0)
+    return -1;
+  r = mmapfile(f, len, prot, flags, off);
+  fileclose(f);
+  return r;
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || len <= 0)
+    return -1;
+  return munmapva(addr, len);
 }
 
 int
@@ -95,10 +278,18 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct tgroup *tg = myproc()->tg;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argint(0, &fd) < 0 || fd < 0 || fd >= NOFILE)
+    return -1;
+  // another thread may be closing it too
+  acquire(&tg->lock);
+  if((f = tg->ofile[fd]) == 0){
+    release(&tg->lock);
     return -1;
-  myproc()->ofile[fd] = 0;
+  }
+  tg->ofile[fd] = 0;
+  release(&tg->lock);
   fileclose(f);
   return 0;
 }
@@ -108,10 +299,13 @@ sys_fstat(void)
 {
   struct file *f;
   struct stat *st;
+  int r;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argwptr(1, (void*)&st, sizeof(*st)) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -329,6 +523,7 @@ sys_open(void)
   f->off = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->direct = (omode & O_DIRECT) != 0;
   return fd;
 }
 
@@ -372,40 +567,49 @@ int
 sys_chdir(void)
 {
   char *path;
-  struct inode *ip;
-  struct proc *curproc = myproc();
+  struct inode *ip, *oldip;
+  struct mntent *mp, *oldmp;
+  struct tgroup *tg = myproc()->tg;
   
   begin_op();
-  if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
+  if(argstr(0, &path) < 0 || (ip = nameimnt(path, &mp)) == 0){
     end_op();
     return -1;
   }
   ilock(ip);
   if(ip->type != T_DIR){
     iunlockput(ip);
+    mntput(mp);
     end_op();
     return -1;
   }
   iunlock(ip);
-  iput(curproc->cwd);
+  acquire(&tg->lock);
+  oldip = tg->cwd;
+  oldmp = tg->cwdmnt;
+  tg->cwd = ip;
+  tg->cwdmnt = mp;
+  release(&tg->lock);
+  iput(oldip);
+  mntput(oldmp);
   end_op();
-  curproc->cwd = ip;
   return 0;
 }
 
-int
-sys_exec(void)
+// Fetch the nth word-sized system call argument as a pointer
+// to a null-terminated array of at most MAXARG-1 strings, and
+// point argv's entries at them.
+static int
+argargv(int n, char **argv)
 {
-  char *path, *argv[MAXARG];
   int i;
   uint uargv, uarg;
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
+  if(argint(n, (int*)&uargv) < 0)
     return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
   for(i=0;; i++){
-    if(i >= NELEM(argv))
+    if(i >= MAXARG)
       return -1;
     if(fetchint(uargv+4*i, (int*)&uarg) < 0)
       return -1;
@@ -416,9 +620,44 @@ sys_exec(void)
     if(fetchstr(uarg, &argv[i]) < 0)
       return -1;
   }
+  return 0;
+}
+
+int
+sys_exec(void)
+{
+  char *path, *argv[MAXARG];
+
+  if(argstr(0, &path) < 0 || argargv(1, argv) < 0){
+    return -1;
+  }
   return exec(path, argv);
 }
 
+int
+sys_spawn(void)
+{
+  char *path, *argv[MAXARG];
+  int i, nfd, *fds, r;
+  struct file *f[NOFILE];
+
+  if(argstr(0, &path) < 0 || argargv(1, argv) < 0 || argint(3, &nfd) < 0 ||
+     nfd < 0 || nfd > NOFILE || argptr(2, (void*)&fds, nfd*sizeof(fds[0])) < 0)
+    return -1;
+  r = 0;
+  for(i = 0; i < nfd; i++){
+    f[i] = 0;
+    if(fds[i] >= 0 && (f[i] = fdget(fds[i])) == 0)
+      r = -1;
+  }
+  if(r == 0)
+    r = spawn(path, argv, f, nfd);
+  for(i = 0; i < nfd; i++)
+    if(f[i])
+      fileclose(f[i]);
+  return r;
+}
+
 int
 sys_pipe(void)
 {
@@ -426,14 +665,14 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argwptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
+      myproc()->tg->ofile[fd0] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -7,21 +7,57 @@
 #include "param.h"
 #include "stat.h"
 #include "sysmount.h"
+#include "mount.h"
 #include "loopdev.h"
+#include "mmu.h"
+#include "proc.h"
+#include "mnt_namespace.h"
 
 
 void mountinit(void) {
   struct mntent * rootmnt = &(gmnt.gmnttable[0]);
-  rootmnt->devno = 0;
+  rootmnt->devno = ROOTDEV;
   rootmnt->mnti = 0;
+  rootmnt->rooti = iget(ROOTDEV, ROOTINO);
+  rootmnt->parent = 0;
   rootmnt->refcnt = 1;
-  gmnt.prootmnt = rootmnt;
-  gmnt.pmntlist = rootmnt;
+  rootmnt->id = 0;
+  gmnt.rootmnt = rootmnt;
+  gmnt.nextid = 1;
 
   initlock(&gmnt.lock, "gmnt");
 
 }
 
+// Take a reference to the device a mount uses, if it is one
+// that goes away with its last mount.
+static void mntdevdup(uint devno) {
+  if (isloopdev(devno)) {
+    devdup(devno);
+  } else if (istmpfsdev(devno)) {
+    tmpfsdup(devno);
+  }
+}
+
+// Must be called inside a transaction since devput() calls iput().
+static void mntdevput(uint devno) {
+  if (isloopdev(devno)) {
+    devput(devno);
+  } else if (istmpfsdev(devno)) {
+    tmpfsput(devno);
+  }
+}
+
+// Whether only one mount still uses device devno.
+static int mntdevlast(uint devno) {
+  if (isloopdev(devno)) {
+    return devref(devno) == 1;
+  } else if (istmpfsdev(devno)) {
+    return tmpfsref(devno) == 1;
+  }
+  return 0;
+}
+
 struct mntent * mntalloc() {
   acquire(&gmnt.lock);
   struct mntent * newmntent = 0;
@@ -35,6 +71,7 @@ struct mntent * mntalloc() {
     panic("[mntalloc] no free mount entry");
   }
   newmntent->refcnt = 2;
+  newmntent->id = gmnt.nextid++;
   release(&gmnt.lock);
   return newmntent;
 }
@@ -47,80 +84,200 @@ struct mntent * mntdup(struct mntent * mntent) {
   return mntent;
 }
 
+// Drop a reference to a mount entry. The last reference releases the
+// mount point, the mounted root, the device and the parent mount.
+// Must be called inside a transaction since it calls iput().
 void mntput(struct mntent * mntent) {
 //  cprintf("mntput %d, ref: %d...\n", (int) mntent->devno, (int) mntent->refcnt);
   acquire(&gmnt.lock);
+  if (mntent->refcnt < 1) {
+    panic("[mntput] mnt entry has a zero refcnt");
+  }
   mntent->refcnt--;
+  if (mntent->refcnt > 0) {
+    release(&gmnt.lock);
+    return;
+  }
+
+  uint devno = mntent->devno;
+  struct inode * mnti = mntent->mnti;
+  struct inode * rooti = mntent->rooti;
+  struct mntent * parent = mntent->parent;
+  if (mnti) {
+    mnti->mounted--;
+  }
+  mntent->devno = 0;
+  mntent->mnti = 0;
+  mntent->rooti = 0;
+  mntent->parent = 0;
+  mntent->next = 0;
   release(&gmnt.lock);
+
+  iput(rooti);
+  if (mnti) {
+    iput(mnti);
+  }
+  mntdevput(devno);
+  if (parent) {
+    mntput(parent);
+  }
+}
+
+// Find the mount with the given id in the list of ns.
+// Called with ns->lock held.
+static struct mntent * mntfind(mnt_namespace_struct * ns, uint id) {
+  for (struct mntent * cur = ns->mntlist; cur != 0; cur = cur->next) {
+    if (cur->id == id) {
+      return cur;
+    }
+  }
+  return 0;
 }
 
 int sys_mount(void) {
   char *mntpnt_path, *dev_path;
+  struct mntent * parent;
+  struct inode * mnti;
+  struct inode * devi = 0;
+  int type;
 
-  if(argstr(0, &dev_path) < 0 || argstr(1, &mntpnt_path) < 0) {
+  if(argstr(0, &dev_path) < 0 || argstr(1, &mntpnt_path) < 0 || argint(2, &type) < 0) {
     return -1;
   }
 
-  begin_op();
+  if (type != MNT_LOOP && type != MNT_BIND && type != MNT_TMPFS) {
+    cprintf("[sys_mount] unknown mount type %d\n", type);
+    return -1;
+  }
 
-  struct inode * mnti = namei(mntpnt_path);
-  struct inode * devi = namei(dev_path);
+  begin_op();
 
+  mnti = nameimnt(mntpnt_path, &parent);
   if (mnti == 0) {
     panic("[sys_mount] mountpoint doesn't exist");
     // end_op();
     // return -1;
   }
 
-  if (devi == 0) {
-    panic("[sys_mount] loop device doesn't exist");
-    // end_op();
-    // return -1;
+  // tmpfs has no device; its first argument is ignored.
+  if (type != MNT_TMPFS) {
+    devi = namei(dev_path);
+    if (devi == 0) {
+      panic("[sys_mount] loop device doesn't exist");
+      // end_op();
+      // return -1;
+    }
+    if (devi == mnti) {
+      cprintf("[sys_mount] cannot mount a directory onto itself\n");
+      iput(devi);
+      devi = 0;
+      ilock(mnti);
+      goto bad;
+    }
   }
 
   ilock(mnti);
-  ilock(devi);
+  if (devi) {
+    ilock(devi);
+  }
 
   if (mnti->inum == ROOTINO) {
     cprintf("[sys_mount] mountpoint corresponds to be root inode\n.");
     // panic("[sys_mount] mountpoint corresponds to be root inode");
-    iunlockput(mnti);
-    iunlockput(devi);
-    end_op();
-    return -1;
+    goto bad;
   }
 
-  if (devi->type != T_FILE) {
+  if (mnti->type != T_DIR) {
+    cprintf("[sys_mount] mountpoint is not a directory\n");
+    goto bad;
+  }
+
+  if (type == MNT_BIND && devi->type != T_DIR) {
+    cprintf("[sys_mount] bind source is not a directory\n");
+    goto bad;
+  }
+
+  if (type == MNT_LOOP && devi->type != T_FILE) {
     cprintf("[sys_mount] device is not a file (only support loop divice for now)");
-    iunlockput(mnti);
-    iunlockput(devi);
-    end_op();
-    return -1;
+    goto bad;
   }
 
-  uint devno = getorcreatedev(devi);
-  is_loop_mounted = 1;
+  // The lookup may have gone through a mount of a list this namespace
+  // no longer uses; hang the new mount off our own copy of it.
+  mnt_namespace_struct * ns = myproc()->nsproxy->mnt_ns;
+  acquire(&ns->lock);
+  struct mntent * cur = mntfind(ns, parent->id);
+  if (cur) {
+    mntdup(cur);
+  }
+  release(&ns->lock);
+  mntput(parent);
+  parent = cur;
+  if (parent == 0) {
+    cprintf("[sys_mount] mountpoint is no longer mounted\n");
+    goto bad;
+  }
+
+  uint devno;
+  struct inode * rooti;
+  if (type == MNT_BIND) {
+    // Graft the directory itself; its blocks stay on the device it lives on.
+    devno = devi->dev;
+    mntdevdup(devno);
+    rooti = idup(devi);
+  } else if (type == MNT_TMPFS) {
+    int tmpdev = tmpfsalloc();
+    if (tmpdev < 0) {
+      cprintf("[sys_mount] cannot create tmpfs\n");
+      goto bad;
+    }
+    devno = tmpdev;
+    rooti = iget(devno, ROOTINO);
+  } else {
+    devno = getorcreatedev(devi);
+    rooti = iget(devno, ROOTINO);
+  }
   struct mntent * newmntent = mntalloc();
 
   newmntent->devno = devno;
   newmntent->mnti = idup(mnti);
+  newmntent->rooti = rooti;
+  newmntent->parent = parent;
 
-  // add to pmnt list
-  newmntent->next = gmnt.pmntlist;
-  gmnt.pmntlist = newmntent;
+  acquire(&gmnt.lock);
+  mnti->mounted++;
+  release(&gmnt.lock);
+
+  // Adding at the head leaves a list shared with a clone untouched.
+  acquire(&ns->lock);
+  newmntent->next = ns->mntlist;
+  ns->mntlist = newmntent;
+  release(&ns->lock);
 
   mntput(newmntent);
   iunlockput(mnti); // newmntent holds a reference
-  iunlockput(devi);
-  // iunlock(mnti); // newmntent holds a reference
-  // iunlock(devi);
+  if (devi) {
+    iunlockput(devi);
+  }
   end_op();
   return 0;
 
+bad:
+  iunlockput(mnti);
+  if (devi) {
+    iunlockput(devi);
+  }
+  if (parent) {
+    mntput(parent);
+  }
+  end_op();
+  return -1;
 }
 
 int sys_umount(void) {
   char *mntpnt_path;
+  struct mntent * m;
+  struct inode * ip;
 
   if(argstr(0, &mntpnt_path) < 0) {
     return -1;
@@ -128,134 +285,161 @@ int sys_umount(void) {
 
   begin_op();
 //  cprintf("we will umount %s\n", mntpnt_path);
-  struct inode * mnti = namei(mntpnt_path);
-
-
-  // struct inode * devi = namei(dev_path);
-
-  if (mnti == 0) {
-    panic("[sys_mount] mountpoint doesn't exist");
-    // end_op();
-    // return -1;
+  if ((ip = nameimnt(mntpnt_path, &m)) == 0) {
+    cprintf("[sys_umount] %s doesn't exist\n", mntpnt_path);
+    end_op();
+    return -1;
   }
 
-  ilock(mnti);
-  if (mnti->dev == ROOTDEV) {
+  if (m->parent == 0) {
     cprintf("[sys_umount] unmount root device\n");
-    iunlock(mnti);
+    iput(ip);
+    mntput(m);
     end_op();
     return -1;
   }
-  
-  if (mnti->inum != ROOTINO) {
+
+  if (ip != m->rooti) {
     cprintf("[sys_umount] unmount non-root node\n");
-    iunlock(mnti);
+    iput(ip);
+    mntput(m);
     end_op();
     return -1;
   }
-  iunlock(mnti);
-
-  
-  struct mntent * m = 0;
-  acquire(&gmnt.lock); 
-  for (struct mntent * cur = gmnt.pmntlist; cur != 0; cur = cur->next) {
-    if (cur->refcnt == 0) {
-      panic("[mntlookup] mnt entry in active mount list has a zero refcnt");
+  iput(ip);
+
+  // Removing a mount changes the list in place, so stop sharing it first.
+  mnt_namespace_struct * ns = myproc()->nsproxy->mnt_ns;
+  for (;;) {
+    unshare_mnt_list(ns);
+    acquire(&ns->lock);
+    if (!ns->shared) {
+      break;
     }
-    if (cur->devno == mnti->dev) { 
-      m = cur;
+    release(&ns->lock);
+  }
+
+  struct mntent * cur = ns->mntlist;
+  struct mntent ** pre = &ns->mntlist;
+
+  while (cur != 0) {
+    if (cur->id == m->id) {
       break;
     }
+    pre = &cur->next;
+    cur = cur->next;
   }
 
-  if (m == 0) {
-    cprintf("[sys_umount] %s doesn't mount to any node\n", mntpnt_path);
-    release(&gmnt.lock); 
+  if (cur == 0) {
+    cprintf("[sys_umount] %s is not mounted in this namespace\n", mntpnt_path);
+    release(&ns->lock);
+    mntput(m);
     end_op();
     return -1;
   }
 
-  if (m->refcnt > 1) {
+  acquire(&gmnt.lock);
+  // The mount list holds one reference and our lookup may hold another;
+  // anything else is a process working inside the mount or a mount on top of it.
+  if (cur->refcnt > 1 + (cur == m)) {
     cprintf("[sys_umount] %s is busy, cannot unmount it\n", mntpnt_path);
-    release(&gmnt.lock); 
+    release(&gmnt.lock);
+    release(&ns->lock);
+    mntput(m);
     end_op();
     return -1;
   }
-  
-  struct mntent * cur = gmnt.pmntlist;
-  struct mntent ** pre = &gmnt.pmntlist;
-
-  while (cur != 0) {
-    if (cur == m) {
-      break;
-    }
-    pre = &cur->next;
-    cur = cur->next;
-  }
+  release(&gmnt.lock);
 
-  if (cur == 0) {
-    panic("[mntlookup] mnt entry is not in active mount list");
+  // The last mount of a device takes the device with it, so files
+  // still open on it keep it busy. The mount's root is the one
+  // reference we expect.
+  if (mntdevlast(cur->devno) && idevref(cur->devno) > 1) {
+    cprintf("[sys_umount] %s has open files, cannot unmount it\n", mntpnt_path);
+    release(&ns->lock);
+    mntput(m);
+    end_op();
+    return -1;
   }
 
   *pre = cur->next;
-  release(&gmnt.lock);
-  
-  devput(cur->devno);
-
-  cur->devno = 0;
-  cur->mnti = 0;
-  cur->next = 0;
-  cur->refcnt = 0;
-  is_loop_mounted = 0;
-
-  struct inode * devi = getlloopdevi(cur->devno);
-  iput(devi);
-  iput(mnti);
-//  cprintf("devi->ref: %d\n", devi->ref);
-//  cprintf("mnti->ref: %d\n", mnti->ref);
+  release(&ns->lock);
+
+  mntput(cur); // the mount list's reference, which tears the mount down
+  mntput(m);
   end_op();
   return 0;
 
 }
 
-// mount point to mntent
-struct mntent * mntlookup(struct inode * ip) {
-  
-  acquire(&gmnt.lock);
-  for (struct mntent * cur = gmnt.pmntlist; cur != 0; cur = cur->next) {
+// Find the mount on mount point ip inside mount parent, in the
+// namespace of the current process. Mounts are matched by id so that a
+// lookup started on a list the namespace has since copied still finds
+// the mounts of the copy.
+// Returns the entry with a reference held, or 0.
+struct mntent * mntlookup(struct mntent * parent, struct inode * ip) {
+  mnt_namespace_struct * ns = myproc()->nsproxy->mnt_ns;
+  struct mntent * m = 0;
+
+  acquire(&ns->lock);
+  for (struct mntent * cur = ns->mntlist; cur != 0; cur = cur->next) {
     if (cur->refcnt == 0) {
       panic("[mntlookup] mnt entry in active mount list has a zero refcnt");
     }
-    // if (cur->mnti == 0) {
-    //   panic("[mntlookup] mountpoint inode is 0");
-    // }
-    if (cur->mnti == ip) { 
-      release(&gmnt.lock);
-      return mntdup(cur);
+    if (cur->mnti == ip && cur->parent != 0 && cur->parent->id == parent->id) {
+      m = mntdup(cur);
+      break;
     }
   }
-
-  release(&gmnt.lock);
-  return 0;
+  release(&ns->lock);
+  return m;
 
 }
 
-
-// mount device to mount point
-struct inode * getmntpnt(uint devno) {
-  acquire(&gmnt.lock);
-  for (struct mntent * cur = gmnt.pmntlist; cur != 0; cur = cur->next) {
-    if (cur->refcnt == 0) {
-      panic("[mntlookup] mnt entry in active mount list has a zero refcnt");
+// Copy the mount list starting at list for a namespace that stops
+// sharing it. The copies keep the ids of the originals, take their own
+// references to the inodes and devices, and hang off each other's
+// copies. The copy of rootmnt is stored in *prootmnt.
+// Called with the namespace lock held; doesn't sleep.
+struct mntent * mntcopylist(struct mntent * list, struct mntent * rootmnt, struct mntent ** prootmnt) {
+  struct mntent * copies[NMNT];
+  struct mntent * head = 0;
+  struct mntent ** tail = &head;
+  struct mntent * cur;
+
+  memset(copies, 0, sizeof(copies));
+  for (cur = list; cur != 0; cur = cur->next) {
+    struct mntent * c = mntalloc();
+    acquire(&gmnt.lock);
+    c->refcnt = 1; // the list's
+    c->id = cur->id;
+    c->devno = cur->devno;
+    if (cur->mnti) {
+      cur->mnti->mounted++;
+    }
+    release(&gmnt.lock);
+    c->mnti = cur->mnti ? idup(cur->mnti) : 0;
+    c->rooti = idup(cur->rooti);
+    mntdevdup(c->devno);
+    copies[cur - gmnt.gmnttable] = c;
+    *tail = c;
+    tail = &c->next;
+  }
+  *tail = 0;
+
+  for (cur = list; cur != 0; cur = cur->next) {
+    struct mntent * c = copies[cur - gmnt.gmnttable];
+    if (cur->parent) {
+      // a parent is always older, so it is further down the same list
+      struct mntent * p = copies[cur->parent - gmnt.gmnttable];
+      if (p == 0) {
+        panic("[mntcopylist] parent mount is not in the list");
+      }
+      c->parent = mntdup(p);
     }
-    // if (cur->mnti == 0) {
-    //   panic("[mntlookup] mountpoint inode is 0");
-    // }
-    if (cur->devno == devno) { 
-      release(&gmnt.lock);
-      return cur->mnti;
+    if (cur == rootmnt) {
+      *prootmnt = c;
     }
   }
-  release(&gmnt.lock);
-  return 0;
-}
\ No newline at end of file
+  return head;
+}
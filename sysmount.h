@@ -1,15 +1,18 @@
-#define NMNT 10
+#define NMNT 32
 
 struct mntent{
+  uint id;                 // shared by the copies a namespace clone makes
   uint devno;
-  struct inode * mnti;
+  struct inode * mnti;     // mount point, an inode of the parent mount
+  struct inode * rooti;    // root of the mounted tree
+  struct mntent * parent;  // mount that mnti lives in, 0 for the root mount
   uint refcnt;
-  struct mntent * next;
+  struct mntent * next;    // next mount in the owning namespace's list
 };
 
 struct {
-  struct spinlock lock;           // guard ref count and pmntlist
+  struct spinlock lock;           // guard ref count, mounted and nextid
   struct mntent gmnttable[NMNT];
-  struct mntent * pmntlist; // per process for namespace, p stands for process
-  struct mntent * prootmnt;  // per process for namespace, never change after initialization
-} gmnt; // global data structure for mount
\ No newline at end of file
+  struct mntent * rootmnt;  // root mount of the initial mount namespace
+  uint nextid;
+} gmnt; // global data structure for mount
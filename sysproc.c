@@ -31,6 +31,18 @@ sys_wait(void)
   return wait();
 }
 
+int
+sys_waitpid(void)
+{
+  int pid, options, *status;
+
+  if(argint(0, &pid) < 0 || argint(1, (int*)&status) < 0 || argint(2, &options) < 0)
+    return -1;
+  if(status != 0 && argwptr(1, (char**)&status, sizeof(*status)) < 0)
+    return -1;
+  return waitpid(pid, status, options);
+}
+
 int
 sys_kill(void)
 {
@@ -41,6 +53,26 @@ sys_kill(void)
   return kill(pid);
 }
 
+int
+sys_setsched(void)
+{
+  int pid, policy, value;
+
+  if(argint(0, &pid) < 0 || argint(1, &policy) < 0 || argint(2, &value) < 0)
+    return -1;
+  return setsched(pid, policy, value);
+}
+
+int
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
 int
 sys_getpid(void)
 {
@@ -55,12 +87,32 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if((addr = growproc(n)) < 0)
     return -1;
   return addr;
 }
 
+int
+sys_clone(void)
+{
+  int fn, arg, stack;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+int
+sys_futex(void)
+{
+  int *addr;
+  int op, val;
+
+  if(argptr(0, (char**)&addr, sizeof(*addr)) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  return futex((uint)addr, op, val);
+}
+
 int
 sys_sleep(void)
 {
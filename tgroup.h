@@ -0,0 +1,14 @@
+// What the threads of a process share. fork() and userinit()
+// make a new group; clone() adds a thread to the caller's.
+// Every thread also has the group's page table in p->pgdir.
+// Include spinlock.h and sleeplock.h first.
+struct tgroup {
+  int ref;                     // Threads in the group, guarded by ptable.lock
+  struct sleeplock vmlock;     // Guards sz, vmas and the user part of pgdir
+  uint sz;                     // Size of process memory (bytes)
+  struct vma vmas[NVMA];       // Memory-mapped files
+  struct spinlock lock;        // Guards ofile, cwd and cwdmnt
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
+  struct mntent *cwdmnt;       // Mount the current directory is in
+};
@@ -0,0 +1,355 @@
+// In-memory file system. Inodes and file data live in kalloc()
+// pages; there is no block device and no log. The inodes are
+// cached in the inode cache like any other, and fs.c reaches the
+// functions here through tmpfsops.
+// Everything is freed when the last mount of the file system goes away.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "stat.h"
+#include "tmpfs.h"
+#include "vfs.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+struct {
+  struct spinlock lock;  // guards ref, itable and the inode types
+  struct tmpfs tmpfstable[NTMPFS]; // array idx is devno without the mask
+} gtmpfs;
+
+int istmpfsdev(uint devno) {
+  return (devno & TMPFS_MASK) != 0;
+}
+
+void tmpfsinit(void) {
+  initlock(&gtmpfs.lock, "tmpfs");
+}
+
+static struct tmpfs * gettmpfs(uint devno) {
+  uint tmpfsno = devno & (~TMPFS_MASK);
+  if (!istmpfsdev(devno) || tmpfsno >= NTMPFS) {
+    panic("[gettmpfs] invalid tmpfs device number");
+  }
+  return &gtmpfs.tmpfstable[tmpfsno];
+}
+
+// The inode inum of fs, allocating its page of the inode table if
+// alloc is set. Called with gtmpfs.lock held.
+static struct tmpdinode * tmpdinode(struct tmpfs * fs, uint inum, int alloc) {
+  uint ipage = inum / TMPIPP;
+  if (ipage >= NTMPIPAGES) {
+    return 0;
+  }
+  if (fs->itable[ipage] == 0) {
+    if (!alloc || (fs->itable[ipage] = (struct tmpdinode *) kalloc()) == 0) {
+      return 0;
+    }
+    memset(fs->itable[ipage], 0, PGSIZE);
+  }
+  return fs->itable[ipage] + inum % TMPIPP;
+}
+
+// Free the data pages of dip.
+static void tmpfree(struct tmpdinode * dip) {
+  for (int i = 0; i < NTMPDIRECT; i++) {
+    if (dip->pages[i]) {
+      kfree(dip->pages[i]);
+      dip->pages[i] = 0;
+    }
+  }
+  if (dip->indirect) {
+    for (int i = 0; i < NTMPINDIRECT; i++) {
+      if (dip->indirect[i]) {
+        kfree(dip->indirect[i]);
+      }
+    }
+    kfree((char *) dip->indirect);
+    dip->indirect = 0;
+  }
+}
+
+// Create a tmpfs holding only an empty root directory.
+// Returns its device number, or -1 if there is no free tmpfs or
+// no memory.
+int tmpfsalloc(void) {
+  struct tmpfs * fs = 0;
+  uint tmpfsno;
+  struct tmpdinode * root;
+  struct dirent * de;
+  char * page;
+
+  acquire(&gtmpfs.lock);
+  for (tmpfsno = 0; tmpfsno < NTMPFS; tmpfsno++) {
+    if (gtmpfs.tmpfstable[tmpfsno].ref == 0) {
+      fs = &gtmpfs.tmpfstable[tmpfsno];
+      break;
+    }
+  }
+  if (fs == 0) {
+    release(&gtmpfs.lock);
+    return -1;
+  }
+  if ((root = tmpdinode(fs, ROOTINO, 1)) == 0 || (page = kalloc()) == 0) {
+    if (fs->itable[0]) {
+      kfree((char *) fs->itable[0]);
+      fs->itable[0] = 0;
+    }
+    release(&gtmpfs.lock);
+    return -1;
+  }
+  fs->ref = 1;
+
+  memset(page, 0, PGSIZE);
+  de = (struct dirent *) page;
+  de[0].inum = ROOTINO;
+  safestrcpy(de[0].name, ".", DIRSIZ);
+  de[1].inum = ROOTINO;
+  safestrcpy(de[1].name, "..", DIRSIZ);
+  root->type = T_DIR;
+  root->nlink = 1;
+  root->size = 2 * sizeof(struct dirent);
+  root->pages[0] = page;
+  release(&gtmpfs.lock);
+
+  superalloc(tmpfsno | TMPFS_MASK, &tmpfsops);
+  return tmpfsno | TMPFS_MASK;
+}
+
+// Take another reference to a tmpfs that is already mounted.
+uint tmpfsdup(uint devno) {
+  struct tmpfs * fs = gettmpfs(devno);
+  acquire(&gtmpfs.lock);
+  if (fs->ref < 1) {
+    panic("[tmpfsdup] tmpfs is not in use");
+  }
+  fs->ref++;
+  release(&gtmpfs.lock);
+  return devno;
+}
+
+// Drop a reference to a tmpfs. The last one frees all of its pages.
+void tmpfsput(uint devno) {
+  struct tmpfs * fs = gettmpfs(devno);
+  acquire(&gtmpfs.lock);
+  if (fs->ref < 1) {
+    panic("[tmpfsput] tmpfs is not in use");
+  }
+  if (--fs->ref > 0) {
+    release(&gtmpfs.lock);
+    return;
+  }
+  for (int i = 0; i < NTMPIPAGES; i++) {
+    if (fs->itable[i] == 0) {
+      continue;
+    }
+    for (int j = 0; j < TMPIPP; j++) {
+      tmpfree(&fs->itable[i][j]);
+    }
+    kfree((char *) fs->itable[i]);
+    fs->itable[i] = 0;
+  }
+  release(&gtmpfs.lock);
+
+  superfree(devno);
+}
+
+// Number of mounts using a tmpfs.
+int tmpfsref(uint devno) {
+  struct tmpfs * fs = gettmpfs(devno);
+  acquire(&gtmpfs.lock);
+  int ref = fs->ref;
+  release(&gtmpfs.lock);
+  return ref;
+}
+
+// Allocate an inode on tmpfs dev, like ialloc().
+static struct inode * tmpfsialloc(struct super * sp, short type) {
+  uint dev = sp->dev;
+  struct tmpfs * fs = gettmpfs(dev);
+  struct tmpdinode * dip;
+
+  acquire(&gtmpfs.lock);
+  for (uint inum = 1; inum < NTMPIPAGES * TMPIPP; inum++) {
+    if ((dip = tmpdinode(fs, inum, 1)) == 0) {
+      break;
+    }
+    if (dip->type == 0) {
+      memset(dip, 0, sizeof(*dip));
+      dip->type = type;
+      release(&gtmpfs.lock);
+      return iget(dev, inum);
+    }
+  }
+  release(&gtmpfs.lock);
+  panic("tmpfsialloc: no inodes");
+}
+
+static struct tmpdinode * tmpfsinode(struct inode * ip) {
+  struct tmpdinode * dip;
+  acquire(&gtmpfs.lock);
+  dip = tmpdinode(gettmpfs(ip->dev), ip->inum, 0);
+  release(&gtmpfs.lock);
+  if (dip == 0) {
+    panic("tmpfsinode: no such inode");
+  }
+  return dip;
+}
+
+// Fill in a locked in-memory inode, like ilock() does from disk.
+static void tmpfsiload(struct inode * ip) {
+  struct tmpdinode * dip = tmpfsinode(ip);
+  ip->type = dip->type;
+  ip->major = dip->major;
+  ip->minor = dip->minor;
+  ip->nlink = dip->nlink;
+  ip->size = dip->size;
+}
+
+// Copy a modified in-memory inode back, like iupdate().
+static void tmpfsiupdate(struct inode * ip) {
+  struct tmpdinode * dip = tmpfsinode(ip);
+  acquire(&gtmpfs.lock);
+  dip->type = ip->type;
+  release(&gtmpfs.lock);
+  dip->major = ip->major;
+  dip->minor = ip->minor;
+  dip->nlink = ip->nlink;
+  dip->size = ip->size;
+}
+
+// Discard the contents of a locked inode, like itrunc().
+static void tmpfsitrunc(struct inode * ip) {
+  tmpfree(tmpfsinode(ip));
+  ip->size = 0;
+  tmpfsiupdate(ip);
+}
+
+// The slot holding data page pn of dip, allocating the indirect
+// page if alloc is set. Returns 0 if there is no such slot.
+static char ** tmppage(struct tmpdinode * dip, uint pn, int alloc) {
+  if (pn < NTMPDIRECT) {
+    return &dip->pages[pn];
+  }
+  pn -= NTMPDIRECT;
+  if (pn >= NTMPINDIRECT) {
+    return 0;
+  }
+  if (dip->indirect == 0) {
+    if (!alloc || (dip->indirect = (char **) kalloc()) == 0) {
+      return 0;
+    }
+    memset(dip->indirect, 0, PGSIZE);
+  }
+  return &dip->indirect[pn];
+}
+
+// Read data from a locked inode, like readi().
+static int tmpfsreadi(struct inode * ip, char * dst, uint off, uint n) {
+  struct tmpdinode * dip = tmpfsinode(ip);
+  uint tot, m;
+  char ** pp;
+
+  if (off > ip->size || off + n < off) {
+    return -1;
+  }
+  if (off + n > ip->size) {
+    n = ip->size - off;
+  }
+
+  for (tot = 0; tot < n; tot += m, off += m, dst += m) {
+    m = min(n - tot, PGSIZE - off % PGSIZE);
+    pp = tmppage(dip, off / PGSIZE, 0);
+    if (pp && *pp) {
+      memmove(dst, *pp + off % PGSIZE, m);
+    } else {
+      memset(dst, 0, m);
+    }
+  }
+  return n;
+}
+
+// Write data to a locked inode, like writei(). Stops short if
+// memory runs out.
+static int tmpfswritei(struct inode * ip, char * src, uint off, uint n) {
+  struct tmpdinode * dip = tmpfsinode(ip);
+  uint tot, m;
+  char ** pp;
+
+  if (off > ip->size || off + n < off) {
+    return -1;
+  }
+  if (off + n > TMPMAXFILE * PGSIZE) {
+    return -1;
+  }
+
+  for (tot = 0; tot < n; tot += m, off += m, src += m) {
+    m = min(n - tot, PGSIZE - off % PGSIZE);
+    if ((pp = tmppage(dip, off / PGSIZE, 1)) == 0) {
+      break;
+    }
+    if (*pp == 0) {
+      if ((*pp = kalloc()) == 0) {
+        break;
+      }
+      memset(*pp, 0, PGSIZE);
+    }
+    memmove(*pp + off % PGSIZE, src, m);
+  }
+
+  if (tot > 0 && off > ip->size) {
+    ip->size = off;
+    tmpfsiupdate(ip);
+  }
+  return tot > 0 || n == 0 ? tot : -1;
+}
+
+// Look for a directory entry, like dirlookup(), scanning the
+// directory's pages in place instead of copying each entry out.
+static struct inode * tmpfsdirlookup(struct inode * dp, char * name, uint * poff) {
+  struct tmpdinode * dip = tmpfsinode(dp);
+  struct dirent * de;
+  char ** pp;
+
+  for (uint off = 0; off < dp->size; off += PGSIZE) {
+    if ((pp = tmppage(dip, off / PGSIZE, 0)) == 0 || *pp == 0) {
+      continue;
+    }
+    uint n = min(dp->size - off, PGSIZE) / sizeof(*de);
+    de = (struct dirent *) *pp;
+    for (uint i = 0; i < n; i++, de++) {
+      if (de->inum != 0 && namecmp(name, de->name) == 0) {
+        if (poff) {
+          *poff = off + i * sizeof(*de);
+        }
+        return iget(dp->dev, de->inum);
+      }
+    }
+  }
+  return 0;
+}
+
+static void tmpfsstati(struct inode * ip, struct stat * st) {
+  st->dev = ip->dev;
+  st->ino = ip->inum;
+  st->type = ip->type;
+  st->nlink = ip->nlink;
+  st->size = ip->size;
+}
+
+struct inodeops tmpfsops = {
+  .ialloc = tmpfsialloc,
+  .iload = tmpfsiload,
+  .iupdate = tmpfsiupdate,
+  .itrunc = tmpfsitrunc,
+  .readi = tmpfsreadi,
+  .writei = tmpfswritei,
+  .dirlookup = tmpfsdirlookup,
+  .stati = tmpfsstati,
+  .pagecache = 0,  // the data is in memory already
+};
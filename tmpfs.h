@@ -0,0 +1,24 @@
+#define NTMPFS 4
+#define TMPFS_MASK 0b1000000 // above the loop device bit
+#define NTMPDIRECT 10
+#define NTMPINDIRECT (PGSIZE / sizeof(char*))
+#define TMPMAXFILE (NTMPDIRECT + NTMPINDIRECT) // in pages
+#define NTMPIPAGES 4
+
+// An inode of a tmpfs, the counterpart of struct dinode.
+struct tmpdinode {
+  short type;
+  short major;
+  short minor;
+  short nlink;
+  uint size;
+  char * pages[NTMPDIRECT];  // data pages
+  char ** indirect;          // page of pointers to further data pages
+};
+
+#define TMPIPP (PGSIZE / sizeof(struct tmpdinode))
+
+struct tmpfs {
+  int ref;  // number of mounts using this file system, 0 if free
+  struct tmpdinode * itable[NTMPIPAGES]; // pages of inodes, allocated on demand
+};
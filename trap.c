@@ -71,6 +71,14 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_WAKE:
+    // Only needed to end the hlt in scheduler().
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_TLB:
+    tlbflushed();
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
@@ -78,6 +86,18 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // a write to a copy-on-write page, or a first touch
+    // of a memory-mapped file page
+    if(myproc() && (tf->cs&3) == DPL_USER){
+      sti();  // cowfault may have to wait for a TLB shootdown
+      if((tf->err & PGFLT_WRITE) && cowfault(rcr2()) == 0)
+        break;
+      if(mmapfault(rcr2(), tf->err & PGFLT_WRITE) == 0)
+        break;
+    }
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
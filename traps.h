@@ -34,5 +34,9 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKE        20      // IPI to wake an idle CPU
+#define IRQ_TLB         21      // IPI to flush a CPU's TLB
 #define IRQ_SPURIOUS    31
 
+// Page fault error code bits
+#define PGFLT_WRITE     0x2     // the access was a write
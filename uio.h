@@ -0,0 +1,7 @@
+// One segment of a readv()/writev() buffer list.
+struct iovec {
+  void *iov_base;
+  uint iov_len;
+};
+
+#define UIO_MAXIOV 16  // most segments in one readv()/writev()
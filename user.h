@@ -4,6 +4,7 @@
 
 struct stat;
 struct rtcdate;
+struct iovec;
 
 // system calls
 int fork(void);
@@ -27,8 +28,24 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
-int mount(const char*, const char*);
+int mount(const char*, const char*, int);
 int umount(const char*);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int pread(int, void*, int, uint);
+int pwrite(int, const void*, int, uint);
+int splice(int, int, int);
+int fcntl(int, int, int);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int fsync(int);
+int fdatasync(int);
+int setsched(int, int, int);
+int setaffinity(int, uint);
+int clone(void(*)(void*), void*, void*);
+int futex(int*, int, int);
+int spawn(char*, char**, int*, int);
+int waitpid(int, int*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
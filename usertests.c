@@ -4,6 +4,10 @@
 #include "user.h"
 #include "fs.h"
 #include "fcntl.h"
+#include "uio.h"
+#include "mman.h"
+#include "futex.h"
+#include "wait.h"
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
@@ -354,6 +358,76 @@ pipe1(void)
   printf(1, "pipe1 ok\n");
 }
 
+// grow a pipe with data in it, and fill it without a reader
+void
+pipesize(void)
+{
+  int fds[2], many[NOFILE/2][2], i, j, cc;
+  static char big[24000];
+
+  printf(1, "pipesize test\n");
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit(1);
+  }
+  if(fcntl(fds[0], F_GETPIPE_SZ, 0) != 4096){
+    printf(1, "pipesize: wrong default size\n");
+    exit(1);
+  }
+  for(i = 0; i < sizeof(big); i++)
+    big[i] = i % 253;
+  if(write(fds[1], big, 3000) != 3000){
+    printf(1, "pipesize: write failed\n");
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 20000) != 32768){
+    printf(1, "pipesize: resize failed\n");
+    exit(1);
+  }
+  if(write(fds[1], big + 3000, sizeof(big) - 3000) != sizeof(big) - 3000){
+    printf(1, "pipesize: write failed\n");
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 4096) >= 0){
+    printf(1, "pipesize: shrank below its contents\n");
+    exit(1);
+  }
+  for(i = 0; i < sizeof(big); i += cc){
+    cc = read(fds[0], buf, sizeof(buf));
+    if(cc <= 0){
+      printf(1, "pipesize: read failed\n");
+      exit(1);
+    }
+    for(j = 0; j < cc; j++){
+      if(buf[j] != big[i + j]){
+        printf(1, "pipesize: wrong data at %d\n", i + j);
+        exit(1);
+      }
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  // pipes can't all grow to the largest size
+  for(i = 0; i < NOFILE/2 - 3; i++){
+    if(pipe(many[i]) != 0){
+      printf(1, "pipe() failed\n");
+      exit(1);
+    }
+    if(fcntl(many[i][1], F_SETPIPE_SZ, PIPEMAXSIZE) < 0)
+      break;
+  }
+  if(i == NOFILE/2 - 3){
+    printf(1, "pipesize: no limit on pipe pages\n");
+    exit(1);
+  }
+  for(j = 0; j <= i; j++){
+    close(many[j][0]);
+    close(many[j][1]);
+  }
+  printf(1, "pipesize ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -1144,6 +1218,730 @@ bigwrite(void)
   printf(1, "bigwrite ok\n");
 }
 
+// writev() several segments, some straddling transactions,
+// then read them back with readv() and pread().
+void
+vectoredio(void)
+{
+  struct iovec iov[3];
+  int fd, i, cc;
+
+  printf(1, "vectoredio test\n");
+
+  for(i = 0; i < 4000; i++)
+    buf[i] = i % 251;
+  unlink("vectoredio");
+  fd = open("vectoredio", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf(1, "cannot create vectoredio\n");
+    exit(1);
+  }
+  iov[0].iov_base = buf;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = buf + 10;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = buf + 10;
+  iov[2].iov_len = 3990;
+  if((cc = writev(fd, iov, 3)) != 4000){
+    printf(1, "writev ret %d\n", cc);
+    exit(1);
+  }
+  if(pwrite(fd, "xy", 2, 1000) != 2){
+    printf(1, "pwrite failed\n");
+    exit(1);
+  }
+  close(fd);
+  buf[1000] = 'x';
+  buf[1001] = 'y';
+
+  fd = open("vectoredio", O_RDONLY);
+  iov[0].iov_base = buf + 4000;
+  iov[0].iov_len = 1500;
+  iov[1].iov_base = buf + 5500;
+  iov[1].iov_len = 2500;
+  if((cc = readv(fd, iov, 2)) != 4000){
+    printf(1, "readv ret %d\n", cc);
+    exit(1);
+  }
+  for(i = 0; i < 4000; i++){
+    if(buf[i] != buf[4000 + i]){
+      printf(1, "readv wrong data at %d\n", i);
+      exit(1);
+    }
+  }
+  if(pread(fd, buf + 4000, 2, 1000) != 2 || buf[4000] != 'x' || buf[4001] != 'y'){
+    printf(1, "pread wrong data\n");
+    exit(1);
+  }
+  if(read(fd, buf + 4000, 1) != 0){
+    printf(1, "pread moved the offset\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("vectoredio");
+
+  printf(1, "vectoredio ok\n");
+}
+
+// splice() a file into a pipe and out of it into another file.
+void
+splicetest(void)
+{
+  int fd, fds[2], pid, i, cc;
+
+  printf(1, "splice test\n");
+
+  for(i = 0; i < 3000; i++)
+    buf[i] = i % 249;
+  unlink("splicein");
+  unlink("spliceout");
+  fd = open("splicein", O_CREATE | O_RDWR);
+  if(fd < 0 || write(fd, buf, 3000) != 3000){
+    printf(1, "cannot create splicein\n");
+    exit(1);
+  }
+  close(fd);
+
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    fd = open("splicein", O_RDONLY);
+    if((cc = splice(fd, fds[1], 5000)) != 3000){
+      printf(1, "splice to pipe ret %d\n", cc);
+      exit(1);
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  fd = open("spliceout", O_CREATE | O_RDWR);
+  while((cc = splice(fds[0], fd, 700)) > 0)
+    ;
+  if(cc < 0){
+    printf(1, "splice from pipe failed\n");
+    exit(1);
+  }
+  close(fds[0]);
+  close(fd);
+  wait();
+
+  fd = open("spliceout", O_RDONLY);
+  if((cc = read(fd, buf + 3000, 4000)) != 3000){
+    printf(1, "spliceout has %d bytes\n", cc);
+    exit(1);
+  }
+  for(i = 0; i < 3000; i++){
+    if(buf[i] != buf[3000 + i]){
+      printf(1, "splice wrong data at %d\n", i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("splicein");
+  unlink("spliceout");
+
+  printf(1, "splice ok\n");
+}
+
+// map a file shared and private, and check that only the
+// shared mapping's stores reach the file
+// two files growing side by side, their blocks allocated
+// only when each write is written back.
+void
+writebacktest(void)
+{
+  int fd[2], i, j, k, n;
+
+  printf(1, "writeback test\n");
+
+  for(j = 0; j < 2; j++){
+    fd[j] = open(j ? "wb1" : "wb0", O_CREATE | O_RDWR);
+    if(fd[j] < 0){
+      printf(1, "cannot create wb%d\n", j);
+      exit(1);
+    }
+  }
+  // past the direct blocks, in pieces that straddle blocks and pages
+  for(i = 0; i < 10000; i += n){
+    n = 10000 - i < 700 ? 10000 - i : 700;
+    for(j = 0; j < 2; j++){
+      memset(buf, 'a' + j + i / 700, n);
+      if(write(fd[j], buf, n) != n){
+        printf(1, "write wb%d failed\n", j);
+        exit(1);
+      }
+    }
+  }
+  if(pwrite(fd[0], "xyz", 3, 4095) != 3){
+    printf(1, "pwrite wb0 failed\n");
+    exit(1);
+  }
+  close(fd[0]);
+  close(fd[1]);
+
+  for(j = 0; j < 2; j++){
+    fd[j] = open(j ? "wb1" : "wb0", O_RDONLY);
+    for(i = 0; i < 10000; i += n){
+      n = 10000 - i < 700 ? 10000 - i : 700;
+      if(read(fd[j], buf, n) != n){
+        printf(1, "read wb%d failed\n", j);
+        exit(1);
+      }
+      for(k = 0; k < n; k++){
+        if(buf[k] != (j == 0 && i + k >= 4095 && i + k < 4098 ?
+                      "xyz"[i + k - 4095] : 'a' + j + i / 700)){
+          printf(1, "wb%d wrong data at %d\n", j, i + k);
+          exit(1);
+        }
+      }
+    }
+    if(read(fd[j], buf, 1) != 0){
+      printf(1, "wb%d too long\n", j);
+      exit(1);
+    }
+    close(fd[j]);
+  }
+  unlink("wb0");
+  unlink("wb1");
+
+  printf(1, "writeback ok\n");
+}
+
+// processes pinned to one CPU, and their children, still all run
+void
+affinitytest(void)
+{
+  int i, j, pid;
+
+  printf(1, "affinity test\n");
+
+  if(setaffinity(0, 0) >= 0){
+    printf(1, "empty affinity mask accepted\n");
+    exit(1);
+  }
+  if(setaffinity(0, 1) < 0){
+    printf(1, "setaffinity failed\n");
+    exit(1);
+  }
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      for(j = 0; j < 1000000; j++)
+        ;
+      // ~1 leaves no CPU on a uniprocessor
+      if(i == 0 && setaffinity(0, ~1) < 0 && setaffinity(0, 1) < 0){
+        printf(1, "child setaffinity failed\n");
+        exit(1);
+      }
+      exit(0);
+    }
+    if(i == 1 && setaffinity(pid, ~0) < 0){
+      printf(1, "setaffinity of child failed\n");
+      exit(1);
+    }
+  }
+  for(i = 0; i < 4; i++){
+    if(wait() < 0){
+      printf(1, "wait failed\n");
+      exit(1);
+    }
+  }
+  setaffinity(0, ~0);
+  printf(1, "affinity test ok\n");
+}
+
+#define NTHREAD 4
+
+int threadcount;
+int threadsdone;
+
+void
+threadmain(void *arg)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++)
+    __sync_fetch_and_add(&threadcount, (int)arg);
+  __sync_fetch_and_add(&threadsdone, 1);
+  futex(&threadsdone, FUTEX_WAKE, 1);
+  exit(0);
+}
+
+// threads share memory with their creator and
+// can wait for each other with futex().
+void
+threadtest(void)
+{
+  char *stacks[NTHREAD];
+  int i, n;
+
+  printf(1, "thread test\n");
+
+  threadcount = threadsdone = 0;
+  for(i = 0; i < NTHREAD; i++){
+    stacks[i] = malloc(4096);
+    if(clone(threadmain, (void*)(i+1), stacks[i] + 4096) < 0){
+      printf(1, "clone failed\n");
+      exit(1);
+    }
+  }
+  while((n = threadsdone) < NTHREAD)
+    futex(&threadsdone, FUTEX_WAIT, n);
+  for(i = 0; i < NTHREAD; i++){
+    if(wait() < 0){
+      printf(1, "wait for thread failed\n");
+      exit(1);
+    }
+    free(stacks[i]);
+  }
+  if(threadcount != 1000 * (1+2+3+4)){
+    printf(1, "threads counted %d\n", threadcount);
+    exit(1);
+  }
+  if(clone(threadmain, 0, (void*)3) >= 0){
+    printf(1, "clone with unaligned stack succeeded\n");
+    exit(1);
+  }
+  printf(1, "thread test ok\n");
+}
+
+char *pinbuf;
+int pinfds[2];
+int pinread;
+
+void
+pinreader(void *arg)
+{
+  pinread = read(pinfds[0], pinbuf, 10);
+  exit(0);
+}
+
+void
+pinwriter(void *arg)
+{
+  sleep(10);
+  write(pinfds[1], "0123456789", 10);
+  exit(0);
+}
+
+// sbrk() must wait for a thread's read() into the memory it
+// takes away, rather than free it under the kernel.
+void
+threadsbrktest(void)
+{
+  char *stacks[2];
+  int i;
+
+  printf(1, "thread sbrk test\n");
+
+  stacks[0] = malloc(4096);
+  stacks[1] = malloc(4096);
+  if(pipe(pinfds) < 0){
+    printf(1, "pipe failed\n");
+    exit(1);
+  }
+  pinbuf = sbrk(4096);
+  pinread = -1;
+  if(clone(pinreader, 0, stacks[0] + 4096) < 0 ||
+     clone(pinwriter, 0, stacks[1] + 4096) < 0){
+    printf(1, "clone failed\n");
+    exit(1);
+  }
+  sleep(5);  // the reader is blocked in read() now
+  if(sbrk(-4096) == (char*)-1){
+    printf(1, "sbrk failed\n");
+    exit(1);
+  }
+  for(i = 0; i < 2; i++){
+    if(wait() < 0){
+      printf(1, "wait for thread failed\n");
+      exit(1);
+    }
+  }
+  if(pinread != 10){
+    printf(1, "read returned %d\n", pinread);
+    exit(1);
+  }
+  close(pinfds[0]);
+  close(pinfds[1]);
+  free(stacks[0]);
+  free(stacks[1]);
+  printf(1, "thread sbrk test ok\n");
+}
+
+// fork() shares memory copy-on-write: writes by the child,
+// from user space or by the kernel, must not reach the parent.
+void
+cowtest(void)
+{
+  char *p;
+  int i, pid, fds[2], sz;
+
+  printf(1, "cow test\n");
+
+  sz = 64*4096;
+  p = sbrk(sz);
+  if(p == (char*)-1){
+    printf(1, "sbrk failed\n");
+    exit(1);
+  }
+  for(i = 0; i < sz; i += 4096)
+    p[i] = i / 4096;
+  if(pipe(fds) < 0){
+    printf(1, "pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < sz; i += 2*4096)
+      p[i] = 'c';
+    if(read(fds[0], p + 4096, 10) != 10){
+      printf(1, "read into shared page failed\n");
+      exit(1);
+    }
+    for(i = 0; i < sz; i += 4096){
+      if(p[i] != (i % (2*4096) ? (i == 4096 ? 'x' : i / 4096) : 'c')){
+        printf(1, "child sees wrong data\n");
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  write(fds[1], "xxxxxxxxxx", 10);
+  wait();
+  for(i = 0; i < sz; i += 4096){
+    if(p[i] != (char)(i / 4096)){
+      printf(1, "child's write reached the parent\n");
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-sz);
+  printf(1, "cow test ok\n");
+}
+
+// spawn() starts a program with the descriptors it is given.
+void
+spawntest(void)
+{
+  char *argv[] = { "echo", "spawned", 0 };
+  char buf[32];
+  int fds[2], cfd[3], pid, n, i;
+
+  printf(1, "spawn test\n");
+
+  if(pipe(fds) < 0){
+    printf(1, "pipe failed\n");
+    exit(1);
+  }
+  cfd[0] = -1;
+  cfd[1] = fds[1];
+  cfd[2] = 2;
+  pid = spawn("echo", argv, cfd, 3);
+  if(pid < 0){
+    printf(1, "spawn failed\n");
+    exit(1);
+  }
+  close(fds[1]);
+  // reaching EOF shows the child has no other copy of fds[1]
+  for(n = 0; n < sizeof(buf)-1 && (i = read(fds[0], buf+n, sizeof(buf)-1-n)) > 0; n += i)
+    ;
+  buf[n] = 0;
+  if(strcmp(buf, "spawned\n") != 0){
+    printf(1, "spawned echo wrote the wrong thing\n");
+    exit(1);
+  }
+  close(fds[0]);
+  if(wait() != pid){
+    printf(1, "wait for spawned echo failed\n");
+    exit(1);
+  }
+
+  if(spawn("nonexistent", argv, cfd, 3) >= 0){
+    printf(1, "spawn of a nonexistent program succeeded\n");
+    exit(1);
+  }
+  cfd[1] = 15;
+  if(spawn("echo", argv, cfd, 3) >= 0){
+    printf(1, "spawn with a closed descriptor succeeded\n");
+    exit(1);
+  }
+  printf(1, "spawn test ok\n");
+}
+
+// kill() finds processes by pid, and the children of an exiting
+// process go to init, not to its parent.
+void
+orphantest(void)
+{
+  int pid, fds[2];
+  char c;
+
+  printf(1, "orphan test\n");
+
+  if(kill(-1) >= 0 || kill(0) >= 0){
+    printf(1, "kill of a bad pid succeeded\n");
+    exit(1);
+  }
+  if(pipe(fds) < 0){
+    printf(1, "pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(fork() == 0){
+      // outlive the parent, then report
+      sleep(10);
+      write(fds[1], "g", 1);
+      exit(0);
+    }
+    exit(0);
+  }
+  if(wait() != pid || wait() != -1){
+    printf(1, "wait saw the grandchild\n");
+    exit(1);
+  }
+  if(read(fds[0], &c, 1) != 1 || c != 'g'){
+    printf(1, "orphaned grandchild didn't run\n");
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  pid = fork();
+  if(pid == 0){
+    for(;;)
+      sleep(1);
+  }
+  if(kill(pid) < 0 || wait() != pid){
+    printf(1, "kill by pid failed\n");
+    exit(1);
+  }
+  printf(1, "orphan test ok\n");
+}
+
+// waitpid() waits for one child, or polls with WNOHANG.
+void
+waitpidtest(void)
+{
+  int i, pid[3], fds[2], status;
+
+  printf(1, "waitpid test\n");
+
+  if(waitpid(-1, 0, WNOHANG) != -1){
+    printf(1, "waitpid without children didn't fail\n");
+    exit(1);
+  }
+  if(pipe(fds) < 0){
+    printf(1, "pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < 3; i++){
+    pid[i] = fork();
+    if(pid[i] < 0){
+      printf(1, "fork failed\n");
+      exit(1);
+    }
+    if(pid[i] == 0){
+      close(fds[1]);
+      read(fds[0], &status, 1);  // until the parent closes the pipe
+      exit(i + 10);
+    }
+  }
+  close(fds[0]);
+  if(waitpid(-1, 0, WNOHANG) != 0 || waitpid(pid[1], 0, WNOHANG) != 0){
+    printf(1, "waitpid WNOHANG didn't return 0\n");
+    exit(1);
+  }
+  close(fds[1]);
+  status = 0;
+  if(waitpid(pid[1], &status, 0) != pid[1] || status != 11){
+    printf(1, "waitpid for one child failed\n");
+    exit(1);
+  }
+  if(waitpid(pid[1], 0, 0) != -1){
+    printf(1, "waitpid for a reaped child didn't fail\n");
+    exit(1);
+  }
+  if(waitpid(getpid(), 0, 0) != -1){
+    printf(1, "waitpid for a non-child didn't fail\n");
+    exit(1);
+  }
+  for(i = 0; i < 2; i++){
+    status = waitpid(-1, 0, 0);
+    if(status != pid[0] && status != pid[2]){
+      printf(1, "waitpid for any child failed\n");
+      exit(1);
+    }
+  }
+  if(wait() != -1){
+    printf(1, "children left over\n");
+    exit(1);
+  }
+  printf(1, "waitpid test ok\n");
+}
+
+void
+fsynctest(void)
+{
+  int fd, i, fds[2];
+
+  printf(1, "fsync test\n");
+
+  unlink("fsyncf");
+  fd = open("fsyncf", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf(1, "cannot create fsyncf\n");
+    exit(1);
+  }
+  memset(buf, 'a', 3000);
+  if(write(fd, buf, 3000) != 3000 || fdatasync(fd) != 0 || fsync(fd) != 0){
+    printf(1, "fsync failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  // O_DIRECT writes whole blocks, except at the end of the file
+  fd = open("fsyncf", O_RDWR | O_DIRECT);
+  if(fd < 0){
+    printf(1, "cannot open fsyncf O_DIRECT\n");
+    exit(1);
+  }
+  memset(buf, 'b', 2048);
+  if(write(fd, buf, 100) >= 0){
+    printf(1, "unaligned O_DIRECT write succeeded\n");
+    exit(1);
+  }
+  if(pwrite(fd, buf, 2048, 1024) != 2048 || pwrite(fd, buf, 2000, 3072) != 2000){
+    printf(1, "O_DIRECT write failed\n");
+    exit(1);
+  }
+  if(pread(fd, buf + 2048, 5072, 0) != 5072){
+    printf(1, "O_DIRECT read failed\n");
+    exit(1);
+  }
+  for(i = 0; i < 5072; i++){
+    if(buf[2048 + i] != (i < 1024 ? 'a' : 'b')){
+      printf(1, "O_DIRECT wrong data at %d\n", i);
+      exit(1);
+    }
+  }
+  if(fsync(fd) != 0){
+    printf(1, "fsync O_DIRECT failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  // the page cache sees what O_DIRECT wrote
+  fd = open("fsyncf", O_RDONLY);
+  if(pread(fd, buf, 10, 1020) != 10 || buf[0] != 'a' || buf[6] != 'b'){
+    printf(1, "cached read after O_DIRECT wrong\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("fsyncf");
+
+  if(pipe(fds) != 0 || fsync(fds[0]) >= 0){
+    printf(1, "fsync of a pipe succeeded\n");
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  printf(1, "fsync ok\n");
+}
+
+void
+mmaptest(void)
+{
+  int fd, i, pid;
+  char *p, *q;
+
+  printf(1, "mmap test\n");
+
+  for(i = 0; i < 6000; i++)
+    buf[i] = i % 247;
+  unlink("mmapfile");
+  fd = open("mmapfile", O_CREATE | O_RDWR);
+  if(fd < 0 || write(fd, buf, 6000) != 6000){
+    printf(1, "cannot create mmapfile\n");
+    exit(1);
+  }
+  p = mmap(0, 6000, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, 6000, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1 || q == (char*)-1){
+    printf(1, "mmap failed\n");
+    exit(1);
+  }
+  for(i = 0; i < 6000; i++){
+    if(p[i] != buf[i] || q[i] != buf[i]){
+      printf(1, "mmap wrong data at %d\n", i);
+      exit(1);
+    }
+  }
+  p[10] = 'a';
+  q[20] = 'b';
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(p[10] != 'a' || q[20] != 'b'){
+      printf(1, "mmap not inherited\n");
+      exit(1);
+    }
+    p[5000] = 'c';
+    exit(0);
+  }
+  wait();
+  if(p[5000] != 'c'){
+    printf(1, "shared mapping not shared\n");
+    exit(1);
+  }
+  // a mapped buffer can be passed to a system call
+  if(write(fd, p, 100) != 100){
+    printf(1, "write from mapping failed\n");
+    exit(1);
+  }
+  if(munmap(p, 6000) < 0 || munmap(q, 6000) < 0){
+    printf(1, "munmap failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, 6000) != 6000 || buf[10] != 'a' || buf[20] != 20 % 247 ||
+     buf[5000] != 'c'){
+    printf(1, "mmap stores wrong in file\n");
+    exit(1);
+  }
+  close(fd);
+  unlink("mmapfile");
+
+  printf(1, "mmap ok\n");
+}
+
 void
 bigfile(void)
 {
@@ -1765,6 +2563,18 @@ main(int argc, char *argv[])
 
   bigargtest();
   bigwrite();
+  vectoredio();
+  splicetest();
+  mmaptest();
+  writebacktest();
+  fsynctest();
+  affinitytest();
+  threadtest();
+  threadsbrktest();
+  cowtest();
+  spawntest();
+  orphantest();
+  waitpidtest();
   bigargtest();
   bsstest();
   sbrktest();
@@ -1781,6 +2591,7 @@ main(int argc, char *argv[])
 
   mem();
   pipe1();
+  pipesize();
   preempt();
   exitwait();
 
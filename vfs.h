@@ -0,0 +1,52 @@
+// Virtual file system switch. Each device holding a file system
+// has a struct super naming the operations of its file system type.
+// Every in-memory inode points at the super of its device, and the
+// generic inode functions in fs.c go through its ops, so a file
+// system type only has to provide these to be mountable.
+
+struct stat;
+struct wbroom;
+
+struct inodeops {
+  struct inode* (*ialloc)(struct super *sp, short type);  // create an inode
+  void (*iload)(struct inode *ip);       // fill in a locked inode for ilock()
+  void (*iupdate)(struct inode *ip);     // write back a locked inode
+  void (*itrunc)(struct inode *ip);      // discard the contents of a locked inode
+  int (*readi)(struct inode *ip, char *dst, uint off, uint n);
+  int (*writei)(struct inode *ip, char *src, uint off, uint n);
+  struct inode* (*dirlookup)(struct inode *dp, char *name, uint *poff);
+  void (*stati)(struct inode *ip, struct stat *st);
+  // write back a dirty page of the page cache
+  int (*writepage)(struct inode *ip, char *data, uint off, uint n, struct wbroom *room);
+  int pagecache;  // keep file data in the page cache?
+};
+
+// Log space left in a transaction writing back cached pages,
+// for allocating the blocks they need.
+struct wbroom {
+  int left;        // log blocks not yet counted
+  uint lastbmap;   // bitmap block counted last
+  int indirect;    // indirect block counted?
+};
+
+#define NSUPER 8  // root disk, loop devices and tmpfs instances
+
+// A file system in use. Types with an on-disk superblock keep a copy
+// here, loaded on first use, along with values derived from it so
+// that allocation never has to read block 1 again.
+struct super {
+  uint dev;
+  struct inodeops *ops;  // 0 if the entry is free
+  struct sleeplock loadlock; // held while loading sb
+  int valid;             // sb and the counts below have been loaded?
+  struct superblock sb;
+
+  struct spinlock lock;  // protects everything below here
+  uint nfreeblocks;      // free data blocks
+  uint nfreeinodes;
+  uint bhint;            // block where balloc() starts looking
+  uint ihint;            // inode where ialloc() starts looking
+};
+
+extern struct inodeops xv6fsops;
+extern struct inodeops tmpfsops;
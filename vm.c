@@ -5,7 +5,11 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "traps.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "tgroup.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -32,7 +36,7 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
@@ -57,7 +61,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -173,10 +177,56 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
+  mycpu()->pgdir = p->pgdir;  // before loading it, for tlbflush()
+  mycpu()->uproc = p;
   lcr3(V2P(p->pgdir));  // switch to process's address space
   popcli();
 }
 
+// Flush the TLB of every CPU that may hold entries of pgdir,
+// after mappings in it were removed or restricted: the CPUs
+// running threads that share it, and those whose scheduler
+// still has it loaded. Waits until they are done, so it must be
+// called with interrupts on, lest two CPUs wait on each other.
+void
+tlbflush(pde_t *pgdir)
+{
+  uint want[NCPU];
+  int i, me;
+
+  __sync_synchronize();  // PTE stores before the loads of pgdir
+  pushcli();
+  me = cpuid();
+  for(i = 0; i < ncpu; i++){
+    want[i] = 0;
+    if(cpus[i].pgdir != pgdir)
+      continue;
+    if(i == me)
+      lcr3(V2P(pgdir));
+    else {
+      want[i] = __sync_add_and_fetch(&cpus[i].flushreq, 1);
+      lapicipi(cpus[i].apicid, T_IRQ0 + IRQ_TLB);
+    }
+  }
+  popcli();
+  for(i = 0; i < ncpu; i++)
+    while(want[i] && (int)(cpus[i].flushdone - want[i]) < 0)
+      ;
+}
+
+// Flush this CPU's TLB for the IRQ_TLB IPI. Requests made
+// after the read of flushreq get an IPI of their own.
+void
+tlbflushed(void)
+{
+  struct cpu *c = mycpu();
+  uint req;
+
+  req = c->flushreq;
+  lcr3(rcr3());
+  c->flushdone = req;
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -278,6 +328,39 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return newsz;
 }
 
+// Like deallocuvm, for a page table other CPUs may be using:
+// no page goes back to kalloc until no TLB can still map it.
+// Caller must have interrupts on (see tlbflush).
+int
+shrinkuvm(pde_t *pgdir, uint oldsz, uint newsz)
+{
+  pte_t *pte;
+  uint a;
+
+  if(newsz >= oldsz)
+    return oldsz;
+
+  for(a = PGROUNDUP(newsz); a < oldsz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(!pte)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else
+      *pte &= ~PTE_P;
+  }
+  tlbflush(pgdir);
+
+  for(a = PGROUNDUP(newsz); a < oldsz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(!pte)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else if(PTE_ADDR(*pte) != 0){
+      kfree(P2V(PTE_ADDR(*pte)));
+      *pte = 0;
+    }
+  }
+  return newsz;
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void
@@ -287,6 +370,11 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
+  // A CPU's scheduler keeps the page table of the last process
+  // it ran loaded until it runs another or goes idle.
+  for(i = 0; i < ncpu; i++)
+    while(cpus[i].pgdir == pgdir)
+      ;
   deallocuvm(pgdir, KERNBASE, 0);
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
@@ -311,9 +399,11 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child. If cow is set, the pages are shared
+// read-only instead, and copied on the first write to them
+// (see cowpage).
 pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+copyuvm(pde_t *pgdir, uint sz, int cow)
 {
   pde_t *d;
   pte_t *pte;
@@ -329,6 +419,16 @@ copyuvm(pde_t *pgdir, uint sz)
       panic("copyuvm: page not present");
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
+    if(cow){
+      if(flags & PTE_W){
+        flags = (flags & ~PTE_W) | PTE_COW;
+        *pte = pa | flags;
+      }
+      if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
+        goto bad;
+      kref(P2V(pa));
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto bad;
     memmove(mem, (char*)P2V(pa), PGSIZE);
@@ -337,13 +437,84 @@ copyuvm(pde_t *pgdir, uint sz)
       goto bad;
     }
   }
+  if(cow)
+    tlbflush(pgdir);  // the parent's pages are read-only now
   return d;
 
 bad:
+  if(cow)
+    tlbflush(pgdir);
   freevm(d);
   return 0;
 }
 
+// Make the page at user address va in pgdir writable if it
+// is copy-on-write, copying it unless pgdir is the last page
+// table sharing it. The caller must keep other threads from
+// changing pgdir, and have interrupts on (see tlbflush).
+// Returns -1 if the page isn't present, or is read-only for
+// good, or memory runs out.
+int
+cowpage(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem, *old;
+
+  if(va >= KERNBASE || (pte = walkpgdir(pgdir, (char*)va, 0)) == 0 ||
+     (*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+    return -1;
+  if(*pte & PTE_W)
+    return 0;
+  if(!(*pte & PTE_COW))
+    return -1;
+  old = P2V(PTE_ADDR(*pte));
+  if(krefcount(old) == 1){
+    *pte = (*pte | PTE_W) & ~PTE_COW;
+    tlbflush(pgdir);
+    return 0;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, old, PGSIZE);
+  *pte = V2P(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW);
+  // No CPU may read the old page through this page table
+  // once the page's other users can write it.
+  tlbflush(pgdir);
+  kfree(old);
+  return 0;
+}
+
+// Handle a write fault at va by the current process.
+// Returns -1 if va isn't a copy-on-write page.
+int
+cowfault(uint va)
+{
+  struct tgroup *tg = myproc()->tg;
+  int r;
+
+  acquiresleep(&tg->vmlock);
+  r = va < tg->sz ? cowpage(myproc()->pgdir, PGROUNDDOWN(va)) : -1;
+  releasesleep(&tg->vmlock);
+  return r;
+}
+
+// Make [addr, addr+n) of the current process's heap writable,
+// so the kernel can write there without faulting.
+int
+cowcheck(uint addr, uint n)
+{
+  struct tgroup *tg = myproc()->tg;
+  uint va;
+  int r;
+
+  r = 0;
+  acquiresleep(&tg->vmlock);
+  for(va = PGROUNDDOWN(addr); va < addr + n && r == 0; va += PGSIZE)
+    r = cowpage(myproc()->pgdir, va);
+  releasesleep(&tg->vmlock);
+  return r;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -361,7 +532,7 @@ uva2ka(pde_t *pgdir, char *uva)
 
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
-// uva2ka ensures this only works for PTE_U pages.
+// cowpage ensures this only works for writable PTE_U pages.
 int
 copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
@@ -371,9 +542,9 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
-    pa0 = uva2ka(pgdir, (char*)va0);
-    if(pa0 == 0)
+    if(cowpage(pgdir, va0) < 0)
       return -1;
+    pa0 = uva2ka(pgdir, (char*)va0);
     n = PGSIZE - (va - va0);
     if(n > len)
       n = len;